@@ -0,0 +1,509 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <print>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ecs/ecs.hpp>
+
+namespace {
+
+// cache line sized, so the working set outgrows the caches
+struct pos {
+    float x, y;
+    float pad[14];
+};
+
+struct vel {
+    float dx, dy;
+    float pad[14];
+};
+
+struct hp {
+    float value;
+    float pad[13];
+    ecs::handle_type owner{};
+};
+
+using clock_type = std::chrono::steady_clock;
+
+// destroy/create pairs timed by the churn benchmarks
+constexpr size_t max_churn = 10'000;
+
+struct result {
+    std::string name;
+    size_t entities;
+    double ns_per_op;
+};
+
+struct world {
+    std::unique_ptr<ecs::registry> reg
+        = std::make_unique<ecs::registry>();
+    std::vector<ecs::handle_type> entities;
+};
+
+// entities with pos, vel and hp, in creation order
+world populate(size_t count)
+{
+    world w;
+    w.entities.reserve(count);
+
+    for (auto i = 0uz; i < count; ++i) {
+        w.entities.push_back(ecs::create(*w.reg,
+                pos{ float(i), 0.f, {} }, vel{ 1.f, 1.f, {} },
+                hp{ 100.f, {}, {} }));
+    }
+
+    return w;
+}
+
+// registry whose range rows point all over the colonies:
+// entities are destroyed at random and replaced right away,
+// so every replacement lands in the hole that was just made
+world fragment(size_t count, std::mt19937 &rng)
+{
+    auto w = populate(count);
+
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    for (auto i = 0uz; i < count; ++i) {
+        auto &ent = w.entities[pick(rng)];
+        ecs::destroy(*w.reg, ent);
+        ent = ecs::create(*w.reg, pos{}, vel{}, hp{});
+    }
+
+    return w;
+}
+
+// best of repeats, setup is not timed
+template <class Setup, class Run>
+double measure(Setup &&setup, Run &&run, size_t ops, int repeats)
+{
+    auto best = std::chrono::nanoseconds::max();
+
+    for (int r = 0; r < repeats; ++r) {
+        auto state = setup();
+
+        const auto start = clock_type::now();
+        run(state);
+        best = std::min(best, std::chrono::duration_cast<
+                std::chrono::nanoseconds>(clock_type::now() - start));
+    }
+
+    return static_cast<double>(best.count()) / ops;
+}
+
+template <class Range>
+void update(Range &&range)
+{
+    for (auto &[p, v, h] : range) {
+        p.x += v.dx;
+        p.y += v.dy;
+        h.value -= p.x * 0.5f;
+    }
+}
+
+class suite {
+public:
+    suite(size_t count, int repeats, std::mt19937 &rng)
+        : count_(count)
+        , repeats_(repeats)
+        , rng_(rng)
+    {
+    }
+
+    void run()
+    {
+        create();
+        destroy();
+        clear();
+        destroy_if();
+        emplace();
+        random_access();
+        iterate();
+        build();
+        churn();
+        fragmented();
+        snapshot();
+        baked();
+        clone();
+    }
+
+    const std::vector<result> &results() const noexcept
+    {
+        return results_;
+    }
+
+private:
+    void report(std::string_view name, double ns)
+    {
+        std::println("  {:<28} {:>12} {:.3f} ns/op",
+                name, count_, ns);
+        results_.push_back({ std::string(name), count_, ns });
+    }
+
+    std::vector<size_t> shuffled()
+    {
+        std::vector<size_t> order(count_);
+        std::iota(order.begin(), order.end(), 0uz);
+        std::ranges::shuffle(order, rng_);
+        return order;
+    }
+
+    void create()
+    {
+        report("create", measure([] { return world{}; },
+            [this](world &w)
+            {
+                for (auto i = 0uz; i < count_; ++i)
+                    ecs::create(*w.reg, pos{}, vel{}, hp{});
+            }, count_, repeats_));
+    }
+
+    void destroy()
+    {
+        const auto order = shuffled();
+
+        report("destroy", measure([this] { return populate(count_); },
+            [&](world &w)
+            {
+                for (const auto i : order)
+                    ecs::destroy(*w.reg, w.entities[i]);
+            }, count_, repeats_));
+    }
+
+    void clear()
+    {
+        report("clear", measure([this] { return populate(count_); },
+            [](world &w) { ecs::clear(*w.reg); }, count_, repeats_));
+    }
+
+    void destroy_if()
+    {
+        // half of the entities, with their ranges cached
+        const auto setup = [this]
+        {
+            auto w = populate(count_);
+            ecs::range<pos, vel>(*w.reg);
+            ecs::range<pos, hp>(*w.reg);
+            return w;
+        };
+
+        report("destroy_if", measure(setup, [](world &w)
+            {
+                ecs::destroy_if<pos>(*w.reg, [](const pos &p)
+                {
+                    return static_cast<size_t>(p.x) % 2 == 0;
+                });
+            }, count_, repeats_));
+    }
+
+    void emplace()
+    {
+        const auto setup = [this]
+        {
+            world w;
+            for (auto i = 0uz; i < count_; ++i)
+                w.entities.push_back(ecs::create(*w.reg));
+            return w;
+        };
+
+        report("emplace", measure(setup, [this](world &w)
+            {
+                for (const auto ent : w.entities)
+                    ecs::emplace(*w.reg, ent, pos{});
+            }, count_, repeats_));
+    }
+
+    void random_access()
+    {
+        auto w = populate(count_);
+        const auto order = shuffled();
+        const auto same = [&w] { return &w; };
+        float sum = 0.f;
+
+        report("get", measure(same, [&](world *w)
+            {
+                for (const auto i : order)
+                    sum += ecs::get<pos>(*w->reg, w->entities[i]).x;
+            }, count_, repeats_));
+
+        std::vector<hp *> hps;
+        for (const auto i : order)
+            hps.push_back(&ecs::get<hp>(*w.reg, w.entities[i]));
+
+        report("sibling", measure(same, [&](world *w)
+            {
+                for (const auto *h : hps)
+                    sum += ecs::sibling<vel>(*w->reg, *h).dx;
+            }, count_, repeats_));
+
+        // keep the loads alive
+        if (sum == 42.f)
+            std::println("");
+    }
+
+    void iterate()
+    {
+        auto w = populate(count_);
+        const auto same = [&w] { return &w; };
+
+        report("range<pos>", measure(same, [](world *w)
+            {
+                for (auto &p : ecs::range<pos>(*w->reg))
+                    p.x += 1.f;
+            }, count_, repeats_));
+
+        // the first call builds the range, time the later ones
+        ecs::range<pos, vel>(*w.reg);
+        report("range<pos, vel>", measure(same, [](world *w)
+            {
+                for (auto &[p, v] : ecs::range<pos, vel>(*w->reg))
+                    p.x += v.dx;
+            }, count_, repeats_));
+
+        ecs::range<pos, vel, hp>(*w.reg);
+        report("range<pos, vel, hp>", measure(same, [](world *w)
+            {
+                update(ecs::range<pos, vel, hp>(*w->reg));
+            }, count_, repeats_));
+
+        ecs::each<pos, vel, hp>(*w.reg, [](auto &...) { });
+        report("each<pos, vel, hp>", measure(same, [](world *w)
+            {
+                ecs::each<pos, vel, hp>(*w->reg,
+                    [](pos &p, vel &v, hp &h)
+                    {
+                        p.x += v.dx;
+                        h.value -= p.x * 0.5f;
+                    });
+            }, count_, repeats_));
+
+        ecs::group<pos, vel, hp>(*w.reg);
+        report("group<pos, vel, hp>", measure(same, [](world *w)
+            {
+                update(ecs::group<pos, vel, hp>(*w->reg));
+            }, count_, repeats_));
+    }
+
+    void build()
+    {
+        auto w = populate(count_);
+
+        report("first range<pos, vel>", measure([&w]
+            {
+                ecs::release_range<pos, vel>(*w.reg);
+                return &w;
+            },
+            [](world *w) { ecs::range<pos, vel>(*w->reg); },
+            count_, repeats_));
+    }
+
+    void churn()
+    {
+        // destroy and recreate entities while ranges are cached
+        const auto setup = [this]
+        {
+            auto w = populate(count_);
+            ecs::range<pos, vel>(*w.reg);
+            ecs::range<pos, hp>(*w.reg);
+            return w;
+        };
+
+        // eager range updates search the rows of every range,
+        // bound the operations so large counts stay feasible
+        auto order = shuffled();
+        order.resize(std::min(count_, max_churn));
+
+        report("churn", measure(setup, [&](world &w)
+            {
+                for (const auto i : order) {
+                    auto &ent = w.entities[i];
+                    ecs::destroy(*w.reg, ent);
+                    ent = ecs::create(*w.reg, pos{}, vel{}, hp{});
+                }
+            }, order.size(), repeats_));
+
+        report("churn deferred", measure(setup, [&](world &w)
+            {
+                ecs::defer_range_updates(*w.reg, true);
+                for (const auto i : order) {
+                    auto &ent = w.entities[i];
+                    ecs::destroy(*w.reg, ent);
+                    ent = ecs::create(*w.reg, pos{}, vel{}, hp{});
+                }
+                ecs::defer_range_updates(*w.reg, false);
+            }, order.size(), repeats_));
+    }
+
+    void fragmented()
+    {
+        auto w = fragment(count_, rng_);
+        const auto same = [&w] { return &w; };
+
+        ecs::range<pos, vel, hp>(*w.reg);
+        report("fragmented range", measure(same, [](world *w)
+            {
+                update(ecs::range<pos, vel, hp>(*w->reg));
+            }, count_, repeats_));
+
+        report("fragmented prefetch<8>", measure(same, [](world *w)
+            {
+                update(ecs::prefetched_range<8, pos, vel, hp>(*w->reg));
+            }, count_, repeats_));
+
+        ecs::optimize(*w.reg);
+        report("fragmented optimized", measure(same, [](world *w)
+            {
+                update(ecs::range<pos, vel, hp>(*w->reg));
+            }, count_, repeats_));
+    }
+
+    void snapshot()
+    {
+        auto w = populate(count_);
+        std::stringstream stream;
+
+        report("save", measure([&]
+            {
+                stream.str({});
+                return &w;
+            },
+            [&stream](world *w)
+            {
+                ecs::save<pos, vel, hp>(*w->reg, stream);
+            }, count_, repeats_));
+
+        const auto saved = stream.str();
+        report("load", measure([&]
+            {
+                stream.str(saved);
+                return world{};
+            },
+            [&stream](world &w)
+            {
+                ecs::load<pos, vel, hp>(*w.reg, stream);
+            }, count_, repeats_));
+    }
+
+    void baked()
+    {
+        const auto path = std::filesystem::temp_directory_path()
+            / "ecs_bench_baked.bin";
+        {
+            auto w = populate(count_);
+            std::ofstream out(path, std::ios::binary);
+            ecs::bake<pos, vel, hp>(*w.reg, out);
+        }
+
+        // compare with load, which creates every entity
+        report("open baked", measure([] { return 0; }, [&path](int)
+            {
+                ecs::baked_segment segment(path);
+            }, count_, repeats_));
+
+        ecs::baked_segment segment(path);
+        float sum = 0.f;
+        report("baked range<pos, vel, hp>", measure([] { return 0; },
+            [&](int)
+            {
+                for (auto &[p, v, h] : ecs::range<pos, vel, hp>(segment))
+                    sum += p.x * v.dx - h.value;
+            }, count_, repeats_));
+
+        if (sum == 42.f)
+            std::println("");
+        std::filesystem::remove(path);
+    }
+
+    void clone()
+    {
+        // ranges and groups are remapped, not rebuilt
+        auto w = populate(count_);
+        ecs::range<pos, vel>(*w.reg);
+        ecs::range<pos, vel, hp>(*w.reg);
+        const auto same = [&w] { return &w; };
+
+        report("clone", measure(same, [](world *w)
+            {
+                auto copy = ecs::clone(*w->reg);
+            }, count_, repeats_));
+    }
+
+    size_t count_;
+    int repeats_;
+    std::mt19937 &rng_;
+    std::vector<result> results_;
+};
+
+void write_json(const std::string &path, const std::vector<result> &results)
+{
+    std::ofstream out(path);
+
+    out << "[\n";
+    for (auto i = 0uz; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << std::format("  {{ \"name\": \"{}\", \"entities\": {}, "
+                "\"ns_per_op\": {:.3f} }}{}\n", r.name, r.entities,
+                r.ns_per_op, i + 1 < results.size() ? "," : "");
+    }
+    out << "]\n";
+}
+
+void usage(const char *self)
+{
+    std::println("usage: {} [--max N] [--repeats N] [--json FILE]", self);
+    std::println("  runs every benchmark for 1K, 10K, ... entities, "
+            "up to N (default 100K)");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t max = 100'000;
+    int repeats = 5;
+    std::string json;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+
+        if (arg == "--max" && i + 1 < argc) {
+            max = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && i + 1 < argc) {
+            json = argv[++i];
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::mt19937 rng(42);
+    std::vector<result> results;
+
+    for (size_t count = 1'000; count <= max; count *= 10) {
+        std::println("{} entities", count);
+
+        suite s(count, repeats, rng);
+        s.run();
+        results.insert(results.end(),
+                s.results().begin(), s.results().end());
+    }
+
+    if (!json.empty())
+        write_json(json, results);
+
+    return 0;
+}
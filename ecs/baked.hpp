@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ECS_BAKED_MMAP 1
+#else
+#include <fstream>
+#endif
+
+#include <ecs/detail/types.hpp>
+#include <ecs/group.hpp>
+
+namespace ecs {
+
+// read-only entities loaded from a file written by
+// registry::bake. The file is mapped into memory and its
+// component arrays are used in place, laid out like those
+// of a group: the i-th element of every array belongs to
+// the i-th entity
+class baked_segment {
+public:
+    static constexpr std::uint32_t magic = 0x42534345; // ECSB
+    // version 2 identifies types by persistent_id
+    static constexpr std::uint32_t version = 2;
+    // of every array relative to the start of the file
+    static constexpr size_t alignment = 64;
+
+    struct header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t entities;
+        std::uint64_t types;
+        std::uint64_t handles;
+    };
+
+    struct type_entry {
+        // persistent_id of the type
+        std::uint64_t id;
+        std::uint64_t size;
+        std::uint64_t offset;
+    };
+
+    explicit baked_segment(const std::filesystem::path &path);
+    baked_segment(baked_segment &&other) noexcept;
+    baked_segment &operator=(baked_segment &&other) noexcept;
+    ~baked_segment();
+
+    size_t size() const noexcept { return header_->entities; }
+
+    // sorted ascending
+    std::span<const handle_type> entities() const noexcept
+    {
+        return { reinterpret_cast<const handle_type *>(
+                data_ + header_->handles), size() };
+    }
+
+    template <class C>
+    bool has() const noexcept
+    {
+        return find(persistent_id<C>) != nullptr;
+    }
+
+    template <class C>
+    std::span<const C> components() const;
+
+    bool contains(handle_type ent) const noexcept
+    {
+        return std::ranges::binary_search(entities(), ent);
+    }
+
+    template <class C>
+    const C &get(handle_type ent) const;
+
+private:
+    void validate(const std::filesystem::path &path);
+    const type_entry *find(std::uint64_t id) const noexcept;
+    void release() noexcept;
+
+    const std::byte *data_ = nullptr;
+    size_t bytes_ = 0;
+    const header *header_ = nullptr;
+    std::span<const type_entry> types_;
+};
+
+// iterates the baked entities that have all Cs
+template <class... Cs>
+class baked_range {
+public:
+    baked_range(const baked_segment &segment);
+
+    groups::iterator<const Cs...> begin() const noexcept;
+    groups::iterator<const Cs...> end() const noexcept;
+
+    size_t size() const noexcept { return size_; }
+
+private:
+    std::array<void *, sizeof...(Cs)> data_;
+    size_t size_;
+};
+
+inline baked_segment::baked_segment(const std::filesystem::path &path)
+{
+    const auto fail = [&path]
+    {
+        return std::runtime_error(
+                std::format("failed to read {}", path.string()));
+    };
+
+#ifdef ECS_BAKED_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw fail();
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        throw fail();
+    }
+
+    bytes_ = static_cast<size_t>(info.st_size);
+    void *data = ::mmap(nullptr, bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        throw fail();
+    data_ = static_cast<const std::byte *>(data);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw fail();
+
+    bytes_ = static_cast<size_t>(in.tellg());
+    auto data = static_cast<char *>(::operator new(bytes_,
+                std::align_val_t{ alignment }));
+    data_ = reinterpret_cast<const std::byte *>(data);
+    in.seekg(0);
+    if (!in.read(data, bytes_)) {
+        release();
+        throw fail();
+    }
+#endif
+
+    try {
+        validate(path);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+inline baked_segment::baked_segment(baked_segment &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , bytes_(std::exchange(other.bytes_, 0))
+    , header_(std::exchange(other.header_, nullptr))
+    , types_(std::exchange(other.types_, {}))
+{
+}
+
+inline baked_segment &baked_segment::operator=(
+    baked_segment &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+        header_ = std::exchange(other.header_, nullptr);
+        types_ = std::exchange(other.types_, {});
+    }
+
+    return *this;
+}
+
+inline baked_segment::~baked_segment()
+{
+    release();
+}
+
+inline void baked_segment::release() noexcept
+{
+    if (data_ == nullptr)
+        return;
+
+#ifdef ECS_BAKED_MMAP
+    ::munmap(const_cast<std::byte *>(data_), bytes_);
+#else
+    ::operator delete(const_cast<std::byte *>(data_),
+            std::align_val_t{ alignment });
+#endif
+    data_ = nullptr;
+}
+
+// checks only the header and the bounds of the arrays, the
+// contents are used as they are
+inline void baked_segment::validate(const std::filesystem::path &path)
+{
+    const auto invalid = [&path]
+    {
+        return std::invalid_argument(
+                std::format("{} is not a baked segment", path.string()));
+    };
+
+    if (bytes_ < sizeof(header))
+        throw invalid();
+
+    header_ = reinterpret_cast<const header *>(data_);
+    if (header_->magic != magic || header_->version != version)
+        throw invalid();
+
+    const auto fits = [this](std::uint64_t offset, std::uint64_t size,
+        std::uint64_t count, size_t align = alignment)
+    {
+        return offset % align == 0 && offset <= bytes_
+            && (size == 0 || count <= (bytes_ - offset) / size);
+    };
+
+    if (!fits(sizeof(header), sizeof(type_entry), header_->types,
+            alignof(type_entry)))
+    {
+        throw invalid();
+    }
+    types_ = { reinterpret_cast<const type_entry *>(
+            data_ + sizeof(header)), header_->types };
+
+    if (!fits(header_->handles, sizeof(handle_type), header_->entities))
+        throw invalid();
+
+    for (const auto &type : types_) {
+        if (!fits(type.offset, type.size, header_->entities))
+            throw invalid();
+    }
+}
+
+inline const baked_segment::type_entry *baked_segment::find(
+    std::uint64_t id) const noexcept
+{
+    const auto it = std::ranges::find(types_, id, &type_entry::id);
+    return it != types_.end() ? &*it : nullptr;
+}
+
+template <class C>
+std::span<const C> baked_segment::components() const
+{
+    const auto type = find(persistent_id<C>);
+    if (type == nullptr || type->size != sizeof(C))
+        throw std::invalid_argument("no such component");
+
+    return { reinterpret_cast<const C *>(data_ + type->offset), size() };
+}
+
+template <class C>
+const C &baked_segment::get(handle_type ent) const
+{
+    const auto ents = entities();
+    const auto it = std::ranges::lower_bound(ents, ent);
+    if (it == ents.end() || *it != ent)
+        throw std::out_of_range("no such entity");
+
+    return components<C>()[std::distance(ents.begin(), it)];
+}
+
+template <class... Cs>
+baked_range<Cs...>::baked_range(const baked_segment &segment)
+    : data_{ const_cast<void *>(static_cast<const void *>(
+            segment.components<Cs>().data()))... }
+    , size_(segment.size())
+{
+}
+
+template <class... Cs>
+groups::iterator<const Cs...> baked_range<Cs...>::begin() const noexcept
+{
+    return groups::iterator<const Cs...>(data_);
+}
+
+template <class... Cs>
+groups::iterator<const Cs...> baked_range<Cs...>::end() const noexcept
+{
+    auto end = data_;
+    [&]<size_t... Is>(std::index_sequence<Is...>)
+    {
+        (..., (end[Is] = static_cast<Cs *>(end[Is]) + size_));
+    }(std::index_sequence_for<Cs...>{});
+
+    return groups::iterator<const Cs...>(end);
+}
+
+} // namespace ecs
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include <ecs/detail/types.hpp>
+#include <ecs/view.hpp>
+
+namespace ecs {
+
+// a component whose value is kept for two frames: the one
+// of the current tick, read by systems, and the one of the
+// next tick, written by them. Both live in the same slot,
+// so advancing the registry tick swaps them without copying.
+// Values that are not written in a tick are those of the
+// tick before the previous one
+template <class C>
+struct double_buffered {
+    double_buffered(const C &value = C())
+        : buffers{ value, value }
+    {
+    }
+
+    const C &prev(size_t tick) const noexcept
+    {
+        return buffers[tick & 1];
+    }
+
+    C &next(size_t tick) noexcept
+    {
+        return buffers[(tick + 1) & 1];
+    }
+
+    std::array<C, 2> buffers;
+};
+
+// range markers: read_prev<C> binds a const C & to the value
+// of the current tick, write_next<C> a C & to that of the next
+template <class C>
+struct read_prev { };
+
+template <class C>
+struct write_next { };
+
+namespace detail {
+
+// maps a range type to the component that is stored and to
+// the reference that is bound
+template <class T>
+struct buffer_access {
+    using component = T;
+    using type = T;
+
+    static type *select(component &comp, size_t) noexcept
+    {
+        return &comp;
+    }
+};
+
+template <class C>
+struct buffer_access<read_prev<C>> {
+    using component = double_buffered<C>;
+    using type = const C;
+
+    static type *select(component &comp, size_t tick) noexcept
+    {
+        return &comp.prev(tick);
+    }
+};
+
+template <class C>
+struct buffer_access<write_next<C>> {
+    using component = double_buffered<C>;
+    using type = C;
+
+    static type *select(component &comp, size_t tick) noexcept
+    {
+        return &comp.next(tick);
+    }
+};
+
+template <class T>
+constexpr bool is_buffer_marker = !std::is_same_v<
+        typename buffer_access<T>::component, T>;
+
+template <class... Ts>
+constexpr bool is_buffered = (is_buffer_marker<Ts> || ...);
+
+} // namespace detail
+
+namespace views {
+
+template <class... Cs>
+class buffered_iterator {
+    static constexpr auto stride = sizeof...(Cs);
+public:
+    buffered_iterator(void **pos, size_t row_size,
+        const std::array<size_t, stride> &columns, size_t tick);
+
+    bool operator==(const buffered_iterator &rhs) const noexcept;
+    bool operator==(const sentinel &sentinel) const noexcept;
+    view<typename detail::buffer_access<Cs>::type...> &operator*();
+    buffered_iterator operator++();
+    buffered_iterator operator++(int);
+
+private:
+    void **pos_;
+    // entity and components of a row of the underlying range
+    size_t row_size_;
+    size_t tick_;
+    // column of the stored component of every C in a row
+    std::array<size_t, stride> columns_;
+
+    // the selected buffers of the current row, in the order
+    // of Cs, see iterator::view_
+    std::array<void *, stride> selected_;
+    std::array<size_t, stride> order_;
+    view<typename detail::buffer_access<Cs>::type...> view_;
+};
+
+} // namespace views
+
+// iterates a range whose types include read_prev or
+// write_next markers, see registry::range. The rows are those
+// of the range over the stored components, so slices of the
+// range can be handed to different threads: the current
+// values are only read and every entity has its own next
+template <class... Cs>
+class buffered_range {
+public:
+    buffered_range(view_range &range, size_t tick);
+
+    views::buffered_iterator<Cs...> begin() const noexcept;
+    views::sentinel end() const noexcept;
+
+    size_t size() const noexcept;
+    // rows [first, first + count), clamped to the range
+    buffered_range slice(size_t first, size_t count) const noexcept;
+
+private:
+    buffered_range(const buffered_range &range, void **first,
+            void **last) noexcept;
+
+    void **first_;
+    void **last_;
+    size_t row_size_;
+    size_t tick_;
+    std::array<size_t, sizeof...(Cs)> columns_;
+};
+
+template <class... Cs>
+buffered_range<Cs...>::buffered_range(view_range &range, size_t tick)
+    : first_(range.views.data())
+    , last_(range.views.data() + range.views.size())
+    , row_size_(range.types.size() + 1)
+    , tick_(tick)
+{
+    const auto column = [&range](auto t)
+    {
+        using type = typename decltype(t)::type;
+        const auto hash = detail::type_hash<
+                typename detail::buffer_access<type>::component>();
+
+        // same as views::iterator, skipping the entity
+        return static_cast<size_t>(std::distance(
+                range.types.find(hash), range.types.end()));
+    };
+
+    auto it = columns_.begin();
+    (..., (*it++ = column(std::type_identity<Cs>{})));
+}
+
+template <class... Cs>
+buffered_range<Cs...>::buffered_range(const buffered_range &range,
+    void **first, void **last) noexcept
+    : first_(first)
+    , last_(last)
+    , row_size_(range.row_size_)
+    , tick_(range.tick_)
+    , columns_(range.columns_)
+{
+}
+
+template <class... Cs>
+views::buffered_iterator<Cs...> buffered_range<Cs...>::begin()
+    const noexcept
+{
+    return views::buffered_iterator<Cs...>(
+            first_, row_size_, columns_, tick_);
+}
+
+template <class... Cs>
+views::sentinel buffered_range<Cs...>::end() const noexcept
+{
+    return views::sentinel(last_);
+}
+
+template <class... Cs>
+size_t buffered_range<Cs...>::size() const noexcept
+{
+    return static_cast<size_t>(last_ - first_) / row_size_;
+}
+
+template <class... Cs>
+buffered_range<Cs...> buffered_range<Cs...>::slice(size_t first,
+    size_t count) const noexcept
+{
+    first = std::min(first, size());
+    count = std::min(count, size() - first);
+
+    return buffered_range(*this, first_ + first * row_size_,
+            first_ + (first + count) * row_size_);
+}
+
+namespace views {
+
+template <class... Cs>
+buffered_iterator<Cs...>::buffered_iterator(void **pos,
+    size_t row_size, const std::array<size_t, stride> &columns,
+    size_t tick)
+    : pos_(pos)
+    , row_size_(row_size)
+    , tick_(tick)
+    , columns_(columns)
+    , view_(nullptr, nullptr)
+{
+    for (auto i = 0uz; i < stride; ++i)
+        order_[i] = i;
+}
+
+template <class... Cs>
+bool buffered_iterator<Cs...>::operator==(
+    const buffered_iterator &rhs) const noexcept
+{
+    return pos_ == rhs.pos_;
+}
+
+template <class... Cs>
+bool buffered_iterator<Cs...>::operator==(
+    const sentinel &sentinel) const noexcept
+{
+    return pos_ == sentinel.pos();
+}
+
+template <class... Cs>
+view<typename detail::buffer_access<Cs>::type...> &
+buffered_iterator<Cs...>::operator*()
+{
+    [this]<size_t... Is>(std::index_sequence<Is...>)
+    {
+        (..., (selected_[Is] = const_cast<void *>(
+                static_cast<const void *>(
+                    detail::buffer_access<Cs>::select(
+                        *static_cast<typename detail::buffer_access<
+                            Cs>::component *>(pos_[columns_[Is]]),
+                        tick_)))));
+    }(std::index_sequence_for<Cs...>{});
+
+    view_ = view<typename detail::buffer_access<Cs>::type...>(
+            order_.data(), selected_.data());
+    return view_;
+}
+
+template <class... Cs>
+buffered_iterator<Cs...> buffered_iterator<Cs...>::operator++()
+{
+    pos_ += row_size_;
+    return *this;
+}
+
+template <class... Cs>
+buffered_iterator<Cs...> buffered_iterator<Cs...>::operator++(int)
+{
+    buffered_iterator temp(*this);
+    ++*this;
+    return temp;
+}
+
+} // namespace views
+} // namespace ecs
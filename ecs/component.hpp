@@ -2,13 +2,17 @@
 
 #pragma once
 
+#include <memory_resource>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace ecs {
 
 struct component {
     size_t hash;
-    void *ptr;
+    // neither hashed nor compared, so the component can be
+    // moved while it is part of a component_set
+    mutable void *ptr;
 
     struct hash_fn {
         size_t operator()(const component &arg) const noexcept
@@ -26,8 +30,11 @@ struct component {
     };
 };
 
-using component_set = std::unordered_set<component,
+using component_set = std::pmr::unordered_set<component,
         component::hash_fn, component::comparison_fn>;
 
+// old -> new address of components that were moved
+using relocation_map = std::pmr::unordered_map<void *, void *>;
+
 } // namespace ecs
 
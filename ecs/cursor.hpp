@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <ecs/detail/types.hpp>
+
+namespace ecs {
+
+class registry;
+
+// position of a time-sliced system in the entities of a
+// component tuple, see registry::resume. A pass visits the
+// entities that have the tuple when it starts, each once,
+// spread over as many calls as needed. Entities destroyed or
+// leaving the tuple meanwhile are skipped, entities joining
+// it are visited by the next pass
+template <class... Cs>
+class range_cursor {
+    static_assert(sizeof...(Cs) > 0);
+    static_assert(detail::pairwise_distinct<Cs...>);
+
+public:
+    // completed passes
+    size_t passes() const noexcept { return passes_; }
+    // entities of the current pass not visited yet, some of
+    // which may no longer exist
+    size_t remaining() const noexcept { return pending_.size() - next_; }
+    // starts a new pass with the next call to resume
+    void reset() noexcept
+    {
+        pending_.clear();
+        next_ = 0;
+    }
+
+private:
+    friend class registry;
+
+    std::vector<handle_type> pending_;
+    size_t next_ = 0;
+    size_t passes_ = 0;
+};
+
+} // namespace ecs
+
+// defines the members that use the registry
+#include <ecs/registry.hpp>
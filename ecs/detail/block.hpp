@@ -3,12 +3,16 @@
 #pragma once
 
 #include <boost/dynamic_bitset.hpp>
+#include <cassert>
+#include <cstring>
 #include <format>
 #include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <ostream>
 #include <stdexcept>
 #include <print>
+#include <type_traits>
 
 namespace ecs {
 namespace detail {
@@ -21,7 +25,8 @@ public:
     using pointer = T *;
 
     block() = default;
-    explicit block(size_type capacity);
+    explicit block(size_type capacity, std::pmr::memory_resource *resource
+            = std::pmr::get_default_resource());
     ~block() noexcept;
     block(block &&other);
     block &operator=(block &&other);
@@ -85,6 +90,11 @@ public:
         return pos >= data_ && pos < data_ + capacity_;
     }
 
+    size_type index_of(pointer pos) const noexcept
+    {
+        return std::distance(data_, pos);
+    }
+
     void erase(pointer pos)
     {
         if (pos < data_ || pos >= data_ + capacity_)
@@ -119,6 +129,7 @@ public:
     friend void swap(block &lhs, block &rhs)
     {
         using std::swap;
+        swap(lhs.resource_, rhs.resource_);
         swap(lhs.capacity_, rhs.capacity_);
         swap(lhs.size_, rhs.size_);
         swap(lhs.data_, rhs.data_);
@@ -127,6 +138,12 @@ public:
 
     void clear()
     {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            // nothing to destroy, just free all slots
+            repack(0);
+            return;
+        }
+
         if (free_ == nullptr) {
             const auto end = data_ + capacity_;
             for (auto it = data_; it != end; ++it)
@@ -144,6 +161,77 @@ public:
         }
     }
 
+    // the first count slots hold elements, e.g. because the
+    // owner moved them there, all remaining slots are free
+    void repack(size_type count) noexcept
+    {
+        assert(count <= capacity_);
+
+        size_ = count;
+        free_ = count < capacity_ ? to_meta(data_ + count) : nullptr;
+        for (auto i = count; i + 1 < capacity_; ++i)
+            *to_meta(data_ + i) = data_ + i + 1;
+        if (count < capacity_)
+            *to_meta(data_ + capacity_ - 1) = nullptr;
+    }
+
+    // rebuilds the free list from the slots for which used
+    // returns false, e.g. after the data was read from a file
+    template <class F>
+    void relink(F &&used) noexcept
+    {
+        size_ = 0;
+        T *next = nullptr;
+        for (auto i = capacity_; i-- > 0; ) {
+            if (used(i)) {
+                ++size_;
+                continue;
+            }
+            *to_meta(data_ + i) = next;
+            next = data_ + i;
+        }
+        free_ = next != nullptr ? to_meta(next) : nullptr;
+    }
+
+    // copies the elements for which used returns true into
+    // the same slots and the free list in the same order, so
+    // both blocks hand out the same slots afterwards
+    template <class F>
+    void copy(const block &other, F &&used)
+    {
+        assert(capacity_ == other.capacity_);
+
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::memcpy(static_cast<void *>(data_), other.data_,
+                    capacity_ * sizeof(T));
+        } else {
+            for (auto i = 0uz; i < capacity_; ++i) {
+                if (used(i))
+                    std::construct_at(data_ + i, other.data_[i]);
+            }
+        }
+
+        size_ = other.size_;
+        free_ = nullptr;
+
+        T **link = nullptr;
+        for (auto free = other.free_; free != nullptr;
+            free = reinterpret_cast<T **>(*free))
+        {
+            T *slot = data_ + (reinterpret_cast<T *>(free) - other.data_);
+            if (link == nullptr)
+                free_ = to_meta(slot);
+            else
+                *link = slot;
+            link = to_meta(slot);
+        }
+        if (link != nullptr)
+            *link = nullptr;
+    }
+
+    T *data() noexcept { return data_; }
+    const T *data() const noexcept { return data_; }
+
     bool has_space() const noexcept { return size_ < capacity_; }
     size_type space() const noexcept { return capacity_ - size_; }
 
@@ -160,6 +248,7 @@ private:
     T **to_meta(T *pos) { return reinterpret_cast<T **>(pos); }
     T *to_data(T **pos) { return reinterpret_cast<T *>(pos); }
 
+    std::pmr::memory_resource *resource_ = nullptr;
     size_type capacity_ = 0;
     size_type size_ = 0;
     T *data_ = nullptr;
@@ -167,9 +256,11 @@ private:
 };
 
 template <class T>
-block<T>::block(size_type capacity)
-    : capacity_(capacity)
-    , data_(static_cast<T *>(::operator new (capacity_ * sizeof(T))))
+block<T>::block(size_type capacity, std::pmr::memory_resource *resource)
+    : resource_(resource)
+    , capacity_(capacity)
+    , data_(static_cast<T *>(resource_->allocate(
+            capacity_ * sizeof(T), alignof(T))))
     , free_(to_meta(data_))
 {
     for (auto i = 0uz; i < capacity_ - 1; ++i)
@@ -185,7 +276,7 @@ block<T>::~block() noexcept
 
     clear();
 
-    ::operator delete (data_);
+    resource_->deallocate(data_, capacity_ * sizeof(T), alignof(T));
 }
 
 template <class T>
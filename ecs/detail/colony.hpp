@@ -3,10 +3,16 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <ranges>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include <ecs/detail/block.hpp>
+#include <ecs/trace.hpp>
 
 namespace ecs {
 namespace detail {
@@ -27,7 +33,22 @@ public:
     using iterator = colony_iterator<colony>;
     using const_iterator = colony_iterator<const colony>;
 
-    colony() = default;
+    colony();
+    explicit colony(std::pmr::memory_resource *resource);
+    // copy with every element in the same slot as in other
+    colony(const colony &other, std::pmr::memory_resource *resource);
+
+    // finds the position of an element by its address in
+    // O(log blocks), valid until blocks are added or removed
+    class address_index {
+    public:
+        explicit address_index(const colony &colony);
+        // npos if the address is not in the colony
+        size_type position(const T *ptr) const noexcept;
+
+    private:
+        std::pmr::vector<std::pair<const T *, size_type>> starts_;
+    };
 
     template <class U>
     size_type push_back(const U &value);
@@ -41,11 +62,25 @@ public:
     void erase(size_type pos);
     iterator erase(iterator it);
     void erase(pointer ptr);
+    template <std::ranges::input_range R>
+    void erase_all(R &&ptrs);
 
     void clear();
 
+    template <class F>
+    void compact(F &&relocate);
+
+    // raw copies of the blocks, for trivially copyable T.
+    // write(const void *, size_t) and read(void *, size_t)
+    // are called with the bytes to copy
+    template <class F>
+    void save(F &&write) const;
+    template <class F>
+    void load(F &&read);
+
     reference at(size_type pos);
     const_reference at(size_type pos) const;
+    pointer slot(size_type pos) noexcept;
     size_type next(size_type pos) const noexcept;
 
     iterator begin() noexcept;
@@ -56,19 +91,28 @@ public:
     size_type capacity() const noexcept;
     size_type size() const noexcept;
 
+    size_type block_count() const noexcept { return blocks_.size(); }
+    // used slots of every block, in the order of the blocks
+    std::vector<size_type> occupancy() const;
+    // blocks and the bitset of used slots
+    size_type reserved_bytes() const noexcept;
+
 private:
     static constexpr size_type block_size = 32;
 
     using block_type = block<T>;
-    using block_container = std::vector<block_type>;
+    using block_container = std::pmr::vector<block_type>;
+    using bitset_type = boost::dynamic_bitset<unsigned long,
+            std::pmr::polymorphic_allocator<unsigned long>>;
 
     size_type offset(block_type &block) const noexcept;
     size_type block_pos(size_type offset) const noexcept;
     block_type &get_free_block();
 
+    std::pmr::memory_resource *resource_;
     size_type size_ = 0;
-    block_container blocks_{};
-    boost::dynamic_bitset<> used_{};
+    block_container blocks_;
+    bitset_type used_;
 };
 
 
@@ -166,14 +210,168 @@ colony<T>::size_type colony<T>::emplace_back(Args &&...args)
     return pos;
 }
 
+template <class T>
+colony<T>::colony()
+    : colony(std::pmr::get_default_resource())
+{
+}
+
+template <class T>
+colony<T>::colony(std::pmr::memory_resource *resource)
+    : resource_(resource)
+    , blocks_(resource)
+    , used_(resource)
+{
+}
+
+template <class T>
+colony<T>::colony(const colony &other,
+    std::pmr::memory_resource *resource)
+    : resource_(resource)
+    , size_(other.size_)
+    , blocks_(resource)
+    , used_(resource)
+{
+    used_ = other.used_;
+
+    blocks_.reserve(other.blocks_.size());
+    for (auto n = 0uz; n < other.blocks_.size(); ++n) {
+        auto &block = blocks_.emplace_back(block_size, resource_);
+
+        const auto offset = n * block_size;
+        block.copy(other.blocks_[n],
+            [&](size_type i) { return used_.test(offset + i); });
+    }
+}
+
+template <class T>
+colony<T>::address_index::address_index(const colony &colony)
+    : starts_(colony.resource_)
+{
+    starts_.reserve(colony.blocks_.size());
+    for (auto n = 0uz; n < colony.blocks_.size(); ++n)
+        starts_.emplace_back(colony.blocks_[n].data(), n);
+    std::ranges::sort(starts_, std::less<>{},
+            &std::pair<const T *, size_type>::first);
+}
+
+template <class T>
+colony<T>::size_type colony<T>::address_index::position(
+    const T *ptr) const noexcept
+{
+    auto it = std::ranges::upper_bound(starts_, ptr, std::less<>{},
+            &std::pair<const T *, size_type>::first);
+    if (it == starts_.begin())
+        return boost::dynamic_bitset<>::npos;
+    --it;
+
+    if (std::less<>{}(ptr, it->first + block_size))
+        return it->second * block_size + (ptr - it->first);
+
+    return boost::dynamic_bitset<>::npos;
+}
+
 template <class T>
 void colony<T>::clear()
 {
+    if (size_ == 0)
+        return;
+
     for (auto &block : blocks_)
         block.clear();
+    used_.reset();
     size_ = 0;
 }
 
+template <class T>
+template <class F>
+void colony<T>::compact(F &&relocate)
+{
+    // the n-th element is moved into the n-th slot, which
+    // is always free as all elements before it are packed
+    size_type to = 0;
+    for (auto from = used_.find_first();
+        from != boost::dynamic_bitset<>::npos;
+        from = used_.find_next(from), ++to)
+    {
+        if (from == to)
+            continue;
+
+        auto src = slot(from);
+        auto dst = slot(to);
+
+        std::construct_at(dst, std::move(*src));
+        std::destroy_at(src);
+        relocate(from, to);
+    }
+
+    const auto used_blocks = (size_ + block_size - 1) / block_size;
+    for (auto n = 0uz; n < used_blocks; ++n)
+        blocks_[n].repack(std::min(block_size, size_ - n * block_size));
+
+    // release the now empty blocks at the back. Their elements
+    // were moved out and destroyed above, so free all of their
+    // slots first, or the blocks would destroy them again
+    for (auto n = used_blocks; n < blocks_.size(); ++n)
+        blocks_[n].repack(0);
+    blocks_.erase(blocks_.begin() + used_blocks, blocks_.end());
+
+    used_.reset();
+    used_.resize(capacity());
+    for (auto pos = 0uz; pos < size_; ++pos)
+        used_.set(pos);
+}
+
+template <class T>
+template <class F>
+void colony<T>::save(F &&write) const
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    const std::uint64_t blocks = blocks_.size();
+    write(&blocks, sizeof(blocks));
+
+    std::vector<bitset_type::block_type> words(used_.num_blocks());
+    boost::to_block_range(used_, words.begin());
+    write(words.data(), words.size() * sizeof(bitset_type::block_type));
+
+    // free slots are copied too, one write per block
+    for (const auto &block : blocks_)
+        write(block.data(), block_size * sizeof(T));
+}
+
+template <class T>
+template <class F>
+void colony<T>::load(F &&read)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    assert(size_ == 0);
+
+    std::uint64_t value = 0;
+    read(&value, sizeof(value));
+    // every block is followed by its elements
+    const auto blocks = read.count(value, block_size * sizeof(T));
+
+    blocks_.clear();
+    used_.clear();
+    used_.resize(blocks * block_size);
+
+    std::vector<bitset_type::block_type> words(used_.num_blocks());
+    read(words.data(), words.size() * sizeof(bitset_type::block_type));
+    boost::from_block_range(words.begin(), words.end(), used_);
+
+    blocks_.reserve(blocks);
+    for (auto n = 0uz; n < blocks; ++n) {
+        auto &block = blocks_.emplace_back(block_size, resource_);
+        read(block.data(), block_size * sizeof(T));
+
+        const auto offset = n * block_size;
+        block.relink([&](size_type i) { return used_.test(offset + i); });
+    }
+
+    size_ = used_.count();
+}
+
 template <class T>
 void colony<T>::erase(size_type pos)
 {
@@ -198,12 +396,30 @@ void colony<T>::erase(pointer ptr)
 {
     for (auto &block : blocks_) {
         if (block.contains(ptr)) {
-            block.erase(ptr);
+            // release the slot so it can be reused
+            erase(offset(block) + block.index_of(ptr));
             return;
         }
     }
 }
 
+template <class T>
+template <std::ranges::input_range R>
+void colony<T>::erase_all(R &&ptrs)
+{
+    // index the blocks once, so every element is found by a
+    // binary search instead of a scan of all blocks
+    const address_index index(*this);
+
+    for (const pointer ptr : ptrs) {
+        if (const auto pos = index.position(ptr);
+            pos != boost::dynamic_bitset<>::npos)
+        {
+            erase(pos);
+        }
+    }
+}
+
 template <class T>
 colony<T>::size_type colony<T>::offset(block_type &block) const noexcept
 {
@@ -236,6 +452,13 @@ colony<T>::const_reference colony<T>::at(size_type pos) const
     return blocks_.at(n).at(pos - n);
 }
 
+template <class T>
+colony<T>::pointer colony<T>::slot(size_type pos) noexcept
+{
+    // address of the slot, whether it's used or not
+    return &blocks_[block_pos(pos)].at(pos % block_size);
+}
+
 template <class T>
 colony<T>::size_type colony<T>::next(size_type pos) const noexcept
 {
@@ -246,7 +469,8 @@ template <class T>
 colony<T>::block_type &colony<T>::get_free_block()
 {
     if (size_ == capacity()) {
-        blocks_.emplace_back(block_size);
+        ECS_TRACE_SCOPE("colony grow");
+        blocks_.emplace_back(block_size, resource_);
         used_.resize(size_ + block_size);
         return blocks_.back();
     }
@@ -295,6 +519,24 @@ colony<T>::size_type colony<T>::size() const noexcept
     return size_;
 }
 
+template <class T>
+std::vector<typename colony<T>::size_type> colony<T>::occupancy() const
+{
+    std::vector<size_type> used;
+    used.reserve(blocks_.size());
+    for (const auto &block : blocks_)
+        used.push_back(block_size - block.space());
+    return used;
+}
+
+template <class T>
+colony<T>::size_type colony<T>::reserved_bytes() const noexcept
+{
+    return capacity() * sizeof(T)
+        + blocks_.capacity() * sizeof(block_type)
+        + used_.num_blocks() * sizeof(typename bitset_type::block_type);
+}
+
 } // namespace detail
 } // namespace ecs
 
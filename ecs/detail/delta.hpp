@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace ecs {
+namespace detail {
+
+// LEB128, small counts and handles take a single byte
+inline void write_varint(std::vector<std::byte> &out, std::uint64_t value)
+{
+    do {
+        auto byte = static_cast<std::uint8_t>(value & 0x7f);
+        value >>= 7;
+        if (value != 0)
+            byte |= 0x80;
+        out.push_back(static_cast<std::byte>(byte));
+    } while (value != 0);
+}
+
+template <class Read>
+std::uint64_t read_varint(Read &&read)
+{
+    std::uint64_t value = 0;
+    for (auto shift = 0u; shift < 64; shift += 7) {
+        std::uint8_t byte = 0;
+        read(&byte, 1);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+
+    throw std::invalid_argument("malformed varint");
+}
+
+// appends cur ^ base as runs of a zero count, a literal
+// count and the literal bytes, until size bytes are covered
+inline void xor_rle_encode(std::vector<std::byte> &out,
+    const std::byte *base, const std::byte *cur, size_t size)
+{
+    for (auto i = 0uz; i < size; ) {
+        auto zeros = 0uz;
+        while (i + zeros < size && base[i + zeros] == cur[i + zeros])
+            ++zeros;
+        i += zeros;
+
+        auto literals = 0uz;
+        while (i + literals < size
+            && base[i + literals] != cur[i + literals])
+        {
+            ++literals;
+        }
+
+        write_varint(out, zeros);
+        write_varint(out, literals);
+        for (auto n = 0uz; n < literals; ++n, ++i)
+            out.push_back(base[i] ^ cur[i]);
+    }
+}
+
+// xors the runs written by xor_rle_encode into dst
+template <class Read>
+void xor_rle_apply(std::byte *dst, size_t size, Read &&read)
+{
+    for (auto i = 0uz; i < size; ) {
+        const auto zeros = read_varint(read);
+        const auto literals = read_varint(read);
+        if (zeros + literals == 0 || zeros + literals > size - i)
+            throw std::invalid_argument("malformed delta run");
+
+        i += zeros;
+        for (auto n = 0uz; n < literals; ++n, ++i) {
+            std::byte byte{};
+            read(&byte, 1);
+            dst[i] ^= byte;
+        }
+    }
+}
+
+} // namespace detail
+} // namespace ecs
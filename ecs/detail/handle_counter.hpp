@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include <ecs/detail/types.hpp>
+
+namespace ecs {
+namespace detail {
+
+// next handle of a registry. Handles may be reserved from
+// any thread, all other operations belong to the owner of
+// the registry, like moving it
+class handle_counter {
+public:
+    explicit handle_counter(handle_type next) noexcept
+        : next_(next)
+    {
+    }
+
+    handle_counter(handle_counter &&other) noexcept
+        : next_(other.load())
+    {
+    }
+
+    handle_counter &operator=(handle_counter &&other) noexcept
+    {
+        store(other.load());
+        return *this;
+    }
+
+    // first of count consecutive handles
+    handle_type reserve(size_t count = 1) noexcept
+    {
+        return next_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    handle_type load() const noexcept
+    {
+        return next_.load(std::memory_order_relaxed);
+    }
+
+    void store(handle_type next) noexcept
+    {
+        next_.store(next, std::memory_order_relaxed);
+    }
+
+    // no handle below next is handed out afterwards
+    void raise(handle_type next) noexcept
+    {
+        auto current = load();
+        while (current < next && !next_.compare_exchange_weak(
+                current, next, std::memory_order_relaxed))
+        {
+        }
+    }
+
+private:
+    std::atomic<handle_type> next_;
+};
+
+} // namespace detail
+} // namespace ecs
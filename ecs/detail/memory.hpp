@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ecs::detail {
+
+// destroys an object created by make_pmr and returns its
+// memory to the resource it came from
+struct pmr_deleter {
+    std::pmr::memory_resource *resource = nullptr;
+    size_t size = 0;
+    size_t alignment = 0;
+
+    template <class T>
+    void operator()(T *ptr) const noexcept
+    {
+        // the memory starts at the most derived object
+        void *memory = ptr;
+        if constexpr (std::is_polymorphic_v<T>)
+            memory = dynamic_cast<void *>(ptr);
+
+        std::destroy_at(ptr);
+        resource->deallocate(memory, size, alignment);
+    }
+};
+
+// unique_ptr<Derived> converts to unique_ptr<Base>, since
+// the deleter does not depend on the type
+template <class T>
+using pmr_ptr = std::unique_ptr<T, pmr_deleter>;
+
+template <class T, class... Args>
+pmr_ptr<T> make_pmr(std::pmr::memory_resource *resource, Args &&...args)
+{
+    void *memory = resource->allocate(sizeof(T), alignof(T));
+
+    try {
+        auto ptr = ::new (memory) T(std::forward<Args>(args)...);
+        return pmr_ptr<T>(ptr, { resource, sizeof(T), alignof(T) });
+    } catch (...) {
+        resource->deallocate(memory, sizeof(T), alignof(T));
+        throw;
+    }
+}
+
+} // namespace ecs::detail
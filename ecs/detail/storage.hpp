@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <functional>
+#include <typeinfo>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <ecs/detail/colony.hpp>
+#include <ecs/detail/memory.hpp>
+#include <ecs/stats.hpp>
+
+namespace ecs {
+namespace detail {
+
+// type erased interface to the components of one type, so
+// the registry can operate on all of them without knowing
+// their types
+class basic_storage {
+public:
+    // called with the old and new address of every
+    // component that is moved to another address
+    using relocate_fn = std::function<void(void *, void *)>;
+    // maps the address of a component to the address of its
+    // copy, nullptr if the component is not in the storage
+    using translate_fn = std::function<void *(void *)>;
+
+    virtual ~basic_storage() = default;
+
+    virtual size_t size() const noexcept = 0;
+    // moves the component at comp into the storage and
+    // returns its new address
+    virtual void *move_in(size_t owner, void *comp) = 0;
+    virtual void erase(void *comp) = 0;
+    virtual void erase(std::span<void *const> comps) = 0;
+    virtual void clear() = 0;
+    virtual void compact(const relocate_fn &relocate) = 0;
+
+    // copy with every component at the same position, throws
+    // std::logic_error if the components are not copyable
+    virtual pmr_ptr<basic_storage> clone(
+            std::pmr::memory_resource *resource) const = 0;
+    // translate_fn for copy, which must be a clone of this
+    // storage, valid until either storage is changed
+    virtual translate_fn translator(basic_storage &copy) const = 0;
+
+    virtual storage_stats stats() const = 0;
+
+    // guards the values of the components, see
+    // registry::read_lock and registry::write_lock
+    std::shared_mutex &mutex() const noexcept { return mutex_; }
+
+private:
+    mutable std::shared_mutex mutex_;
+};
+
+template <class T>
+class storage final : public basic_storage {
+public:
+    explicit storage(std::pmr::memory_resource *resource)
+        : components_(resource)
+        , owners_(resource)
+    {
+    }
+
+    storage(const storage &other, std::pmr::memory_resource *resource)
+        : components_(other.components_, resource)
+        , owners_(other.owners_, resource)
+    {
+    }
+
+    colony<T> &components() noexcept { return components_; }
+    const colony<T> &components() const noexcept
+    {
+        return components_;
+    }
+
+    template <class U>
+    T *insert(size_t owner, U &&value)
+    {
+        const auto pos = components_.push_back(std::forward<U>(value));
+
+        if (owners_.size() < components_.capacity())
+            owners_.resize(components_.capacity());
+        owners_[pos] = owner;
+
+        return components_.slot(pos);
+    }
+
+    // entity of the component at pos of the colony
+    size_t owner(size_t pos) const noexcept { return owners_[pos]; }
+
+    size_t size() const noexcept override
+    {
+        return components_.size();
+    }
+
+    void *move_in(size_t owner, void *comp) override
+    {
+        return insert(owner, std::move(*static_cast<T *>(comp)));
+    }
+
+    void erase(void *comp) override
+    {
+        components_.erase(static_cast<T *>(comp));
+    }
+
+    void erase(std::span<void *const> comps) override
+    {
+        components_.erase_all(comps | std::views::transform(
+                [](void *comp) { return static_cast<T *>(comp); }));
+    }
+
+    void clear() override
+    {
+        components_.clear();
+    }
+
+    template <class F>
+    void save(F &&write) const
+    {
+        components_.save(write);
+        write(owners_.data(), components_.capacity() * sizeof(size_t));
+    }
+
+    template <class F>
+    void load(F &&read)
+    {
+        components_.load(read);
+        owners_.resize(components_.capacity());
+        read(owners_.data(), owners_.size() * sizeof(size_t));
+    }
+
+    storage_stats stats() const override
+    {
+        storage_stats out;
+        out.hash = typeid(T).hash_code();
+        out.name = typeid(T).name();
+        out.component_size = sizeof(T);
+        out.size = components_.size();
+        out.capacity = components_.capacity();
+        out.blocks = components_.block_count();
+        out.bytes = components_.reserved_bytes()
+            + owners_.capacity() * sizeof(size_t);
+
+        for (const auto used : components_.occupancy()) {
+            if (out.occupancy.size() <= used)
+                out.occupancy.resize(used + 1);
+            ++out.occupancy[used];
+        }
+
+        return out;
+    }
+
+    void compact(const relocate_fn &relocate) override
+    {
+        components_.compact([this, &relocate](size_t from, size_t to)
+        {
+            owners_[to] = owners_[from];
+            relocate(components_.slot(from), components_.slot(to));
+        });
+    }
+
+    pmr_ptr<basic_storage> clone(
+        std::pmr::memory_resource *resource) const override
+    {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            return make_pmr<storage>(resource, *this, resource);
+        } else {
+            throw std::logic_error("component is not copyable");
+        }
+    }
+
+    translate_fn translator(basic_storage &copy) const override
+    {
+        auto &target = static_cast<storage &>(copy).components_;
+
+        return [index = typename colony<T>::address_index(components_),
+            &target](void *comp) -> void *
+        {
+            const auto pos = index.position(static_cast<T *>(comp));
+            if (pos == boost::dynamic_bitset<>::npos)
+                return nullptr;
+            return target.slot(pos);
+        };
+    }
+
+private:
+    colony<T> components_;
+    // owners_[i] is the entity of the i-th component
+    std::pmr::vector<size_t> owners_;
+};
+
+} // namespace detail
+} // namespace ecs
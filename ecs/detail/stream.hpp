@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <stdexcept>
+
+namespace ecs::detail {
+
+// reads a persisted format, e.g. a snapshot. Counts read
+// from the stream are checked against the bytes left in it
+// before anything is allocated for them
+class stream_reader {
+public:
+    // truncated is the message of the runtime_error thrown
+    // when the stream ends early
+    stream_reader(std::istream &in, const char *truncated);
+
+    void operator()(void *dst, size_t bytes);
+
+    // returns count if count elements of at least size bytes
+    // each can follow, throws std::runtime_error otherwise
+    size_t count(std::uint64_t count, size_t size) const;
+
+private:
+    std::istream &in_;
+    const char *truncated_;
+    // max for streams that cannot seek, whose counts are
+    // then only checked for overflow
+    std::uint64_t remaining_ = std::numeric_limits<std::uint64_t>::max();
+};
+
+inline stream_reader::stream_reader(std::istream &in, const char *truncated)
+    : in_(in)
+    , truncated_(truncated)
+{
+    const auto pos = in_.tellg();
+    if (pos == std::istream::pos_type(-1))
+        return;
+
+    if (in_.seekg(0, std::ios::end)) {
+        const auto end = in_.tellg();
+        if (end != std::istream::pos_type(-1) && end >= pos)
+            remaining_ = static_cast<std::uint64_t>(end - pos);
+    }
+
+    in_.clear();
+    in_.seekg(pos);
+}
+
+inline void stream_reader::operator()(void *dst, size_t bytes)
+{
+    if (bytes > remaining_
+        || !in_.read(static_cast<char *>(dst), bytes))
+    {
+        throw std::runtime_error(truncated_);
+    }
+
+    if (remaining_ != std::numeric_limits<std::uint64_t>::max())
+        remaining_ -= bytes;
+}
+
+inline size_t stream_reader::count(std::uint64_t count, size_t size) const
+{
+    const auto limit = std::min<std::uint64_t>(remaining_,
+            std::numeric_limits<size_t>::max());
+    if (size != 0 && count > limit / size)
+        throw std::runtime_error(truncated_);
+
+    return static_cast<size_t>(count);
+}
+
+} // namespace ecs::detail
@@ -3,6 +3,9 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <source_location>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <typeinfo>
@@ -62,6 +65,20 @@ auto type_hash()
     return typeid(T).hash_code();
 }
 
+// FNV-1a of the signature of this function, which names T
+template <class T>
+consteval std::uint64_t type_name_hash()
+{
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (const auto c : std::string_view(
+            std::source_location::current().function_name()))
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+
+    return hash;
+}
+
 template <class... Ts>
 auto xor_type_hash()
 {
@@ -84,6 +101,22 @@ template <class T, size_t N>
 using repeated_tuple = decltype(
         repeated_tuple_impl<T>(std::make_index_sequence<N>()));
 
+// the tuple of Ts without repetitions, in order of first
+// occurrence
+template <class Tuple, class... Ts>
+struct unique_tuple {
+    using type = Tuple;
+};
+
+template <class... Us, class T, class... Ts>
+struct unique_tuple<std::tuple<Us...>, T, Ts...>
+    : unique_tuple<std::conditional_t<is_one_of<T, Us...>,
+            std::tuple<Us...>, std::tuple<Us..., T>>, Ts...> {
+};
+
+template <class... Ts>
+using unique_tuple_t = typename unique_tuple<std::tuple<>, Ts...>::type;
+
 template <class C>
 concept FatComponent = requires(const C &comp)
 {
@@ -92,5 +125,15 @@ concept FatComponent = requires(const C &comp)
 };
 
 } // namespace detail
+
+// id of a component type in snapshots, deltas, journals and
+// baked segments. Unlike type_info::hash_code it is the same
+// in every run, as it is derived from the name of the type.
+// Names differ between compilers, specialize it to exchange
+// files between them or to keep them readable after a type
+// was renamed
+template <class T>
+constexpr std::uint64_t persistent_id = detail::type_name_hash<T>();
+
 } // namespace ecs
 
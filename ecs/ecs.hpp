@@ -2,7 +2,11 @@
 
 #pragma once
 
+#include <ecs/cursor.hpp>
+#include <ecs/perf.hpp>
 #include <ecs/registry.hpp>
+#include <ecs/spawn.hpp>
+#include <ecs/task.hpp>
 
 namespace ecs {
 
@@ -27,6 +31,44 @@ handle_type create(registry &reg, Cs &&...components)
     return reg.create(std::forward<Cs>(components)...);
 }
 
+/** Returns the handle of an entity created from a thread
+    other than the one using the registry. The entity is
+    added to the registry of the buffer by publish().
+
+    Every thread uses its own buffer. Handles are reserved
+    in batches without locking, the components are staged
+    in the buffer.
+
+    @param buffer
+
+    @param components Arguments forwarded to initialize the
+    components.
+*/
+template <class... Cs>
+handle_type create(spawn_buffer &buffer, Cs &&...components)
+{
+    return buffer.create(std::forward<Cs>(components)...);
+}
+
+/** Adds the entities staged in the buffer to the registry,
+    in the order they were created, and empties the buffer.
+    Call it from the thread using the registry, e.g. once
+    the workers of a tick have finished.
+
+    If moving a component into the registry throws, the
+    entities published before stay in the registry, the
+    entity that failed is discarded along with the components
+    it got so far, and the later ones stay in the buffer.
+
+    @param reg
+
+    @param buffer A buffer created for reg.
+*/
+inline void publish(registry &reg, spawn_buffer &buffer)
+{
+    reg.publish(buffer);
+}
+
 /** Returns a handle to a newly created entity.
 
     This entity is associated with no components, but new
@@ -73,6 +115,61 @@ inline void destroy(registry &reg, F const &comp)
     reg.destroy(reg.entity_of(comp));
 }
 
+/** Destroys every entity associated with the component
+    tuple for which pred returns true.
+
+    All entities are destroyed at once, every range is
+    updated in a single pass, so this is much faster than
+    calling destroy() for every entity.
+
+    Returns the number of destroyed entities.
+
+    @note pred must not create, emplace or destroy.
+
+    @param reg
+
+    @param pred Called with a reference to every component
+    of the tuple, in the order of the template arguments.
+
+    @tparam C, Cs The component tuple to iterate over.
+*/
+template <class C, class... Cs, class F>
+size_t destroy_if(registry &reg, F &&pred)
+{
+    return reg.destroy_if<C, Cs...>(std::forward<F>(pred));
+}
+
+/** Destroys all entities and their components.
+
+    Ranges and groups stay declared but are emptied at once,
+    memory is kept for reuse. Meant to tear down a level, far
+    faster than destroying every entity. Singletons are kept.
+
+    @note Ranges obtained before are empty.
+
+    @param reg
+*/
+inline void clear(registry &reg)
+{
+    reg.clear();
+}
+
+/** Destroys the components of type C of all entities, the
+    entities themselves are kept.
+
+    If C is owned by a group, the group is emptied and the
+    other components of its entities are moved out of it.
+
+    @param reg
+
+    @tparam C The type of the components to destroy.
+*/
+template <class C>
+void clear(registry &reg)
+{
+    reg.clear<C>();
+}
+
 /** Returns the component of an entity.
 
     @throws out_of_range if the entity does not exist or
@@ -85,6 +182,11 @@ inline void destroy(registry &reg, F const &comp)
 
     @tparam The type of the component to get.
 
+    @note Only safe next to other threads while the registry
+    is frozen, see freeze(). read_lock() and write_lock()
+    guard the values of components, not the entities, so
+    they do not protect get() from a thread that creates or
+    destroys entities.
 */
 template <class C>
 C &get(registry &reg, handle_type ent)
@@ -97,6 +199,9 @@ C &get(registry &reg, handle_type ent)
     @param reg
 
     @param ent Entity to check for.
+
+    @note Only safe next to other threads while the registry
+    is frozen, see freeze() and get().
 */
 inline bool contains(registry &reg, handle_type ent) noexcept
 {
@@ -117,6 +222,13 @@ inline bool contains(registry &reg, handle_type ent) noexcept
     @tparam Cs Optional, further component types that will
     allow you to iterate over component tuples.
 
+    read_prev<T> and write_next<T> select a buffer of the
+    double_buffered<T> components: the tuple binds the value
+    of the current tick as const T & and that of the next
+    tick as T &. Slices of such a range may be iterated by
+    several threads at once without locking, see
+    buffered_range::slice.
+
 */
 template <class C, class... Cs>
 auto range(registry &reg)
@@ -124,6 +236,548 @@ auto range(registry &reg)
     return reg.range<C, Cs...>();
 }
 
+/** Returns a range to iterate over the components of the
+    baked entities in a segment, in place. The components
+    are read-only.
+
+    @throws invalid_argument if a type was not baked.
+
+    @param segment
+
+    @tparam C, Cs The component tuple to iterate over, a
+    subset of the baked types.
+*/
+template <class C, class... Cs>
+baked_range<C, Cs...> range(const baked_segment &segment)
+{
+    return baked_range<C, Cs...>(segment);
+}
+
+/** Calls fn for every entity associated with the component
+    tuple, without creating a range.
+
+    Unlike range(), nothing is cached: the components of the
+    type with the fewest instances are visited and the others
+    are looked up for every entity. Use this for queries that
+    run rarely, e.g. for debugging, as they cause no extra
+    work on later create(), emplace() and destroy() calls.
+
+    @note fn must not create, emplace or destroy.
+
+    @param reg
+
+    @param fn Called with a reference to every component of
+    the tuple, in the order of the template arguments.
+
+    @tparam C, Cs The component tuple to iterate over.
+*/
+template <class C, class... Cs, class F>
+void each(registry &reg, F &&fn)
+{
+    reg.each<C, Cs...>(std::forward<F>(fn));
+}
+
+/** Calls fn for the next entities of the cursor's pass over
+    the component tuple, until max_entities were visited or
+    the budget is spent, and returns whether the pass is
+    complete. The next call then starts a new pass.
+
+    Entities and components may be created and destroyed
+    between calls: a pass visits every entity that had the
+    tuple when the pass started and still has it, exactly
+    once. Entities that join the tuple are visited in the
+    next pass.
+
+    @param reg
+
+    @param cursor Position in the pass, kept by the caller
+    between calls, e.g. ticks.
+
+    @param fn Called with the components of an entity, in
+    the order of Cs.
+
+    @param max_entities Entities to visit at most.
+
+    @param budget Time after which no further entity is
+    visited. The clock is read after every entity, so fn
+    should be the expensive part.
+*/
+template <class... Cs, class F>
+bool resume(registry &reg, range_cursor<Cs...> &cursor, F &&fn,
+    size_t max_entities,
+    std::chrono::nanoseconds budget = std::chrono::nanoseconds::max())
+{
+    return reg.resume(cursor, std::forward<F>(fn), max_entities, budget);
+}
+
+/** Returns a range to iterate over component tuples, like
+    range(), that prefetches the components of the entity D
+    rows ahead while the current one is processed.
+
+    Use this when the ranges' rows no longer follow the
+    memory order of the components, e.g. after lots of
+    entities were created and destroyed.
+
+    @param reg
+
+    @tparam D Prefetch distance in rows, tune to the amount
+    of work done per entity.
+
+    @tparam C, Cs The component tuple to iterate over, at
+    least two components.
+*/
+template <size_t D, class C, class... Cs>
+auto prefetched_range(registry &reg)
+{
+    static_assert(sizeof...(Cs) > 0,
+            "components of a single type are already "
+            "iterated in memory order");
+
+    return reg.range<C, Cs...>().template prefetch<D>();
+}
+
+/** Returns a range to iterate over the component tuples of
+    an owning group.
+
+    The first call declares the group: from then on, the
+    components Cs of every entity that owns all of them are
+    kept in dense arrays, in the same order for every type.
+    Iterating the group is a linear walk over these arrays,
+    the fastest iteration the registry offers.
+
+    @note Components in a group are moved whenever entities
+    join or leave the group, references to them are only
+    valid until the next create(), emplace() or destroy().
+
+    @throws logic_error if one of the types is already owned
+    by another group.
+
+    @param reg
+
+    @tparam Cs The component types owned by the group.
+*/
+template <class... Cs>
+auto group(registry &reg)
+{
+    return reg.group<Cs...>();
+}
+
+/** Drops the cached range of the component tuple, it is no
+    longer updated by create(), emplace() and destroy().
+    Requesting the range again rebuilds it.
+
+    @note Ranges obtained before are invalidated.
+
+    Returns false if the range was not cached.
+
+    @param reg
+
+    @tparam C, Cs The component tuple of the range, at least
+    two components.
+*/
+template <class C, class... Cs>
+bool release_range(registry &reg)
+{
+    return reg.release_range<C, Cs...>();
+}
+
+/** Returns the usage of the cached range of the component
+    tuple, i.e. the tick it was last requested in and how
+    often it was requested, or nullopt if it is not cached.
+
+    @param reg
+
+    @tparam C, Cs The component tuple of the range, at least
+    two components.
+*/
+template <class C, class... Cs>
+std::optional<range_usage> usage(const registry &reg)
+{
+    return reg.usage<C, Cs...>();
+}
+
+/** Evicts cached ranges that were not requested within the
+    last ticks calls to tick(). Disabled by default or if
+    ticks is 0.
+
+    @param reg
+
+    @param ticks Number of ticks a range may stay unused.
+*/
+inline void evict_ranges_after(registry &reg, size_t ticks) noexcept
+{
+    reg.evict_ranges_after(ticks);
+}
+
+/** Builds the ranges of the component tuples, so their
+    first use, e.g. in the first tick after loading a level,
+    does not stall. Ranges over many entities are built on
+    multiple threads, the call returns once all are built.
+
+    @param reg
+
+    @tparam Tuples The component tuples as std::tuple<Cs...>,
+    i.e. prebuild<std::tuple<pos, vel>, std::tuple<pos, hp>>.
+*/
+template <class... Tuples>
+void prebuild(registry &reg)
+{
+    reg.prebuild<Tuples...>();
+}
+
+/** Writes the entities and their components of the types
+    Cs to out, in the binary format of this machine.
+
+    Components of other types are not saved, neither are
+    singletons. Components are copied block by block. Types
+    are identified by persistent_id, so snapshots can be
+    loaded by other runs of the program.
+
+    @throws runtime_error if writing fails.
+
+    @param reg
+
+    @param out Stream to write to, opened in binary mode.
+
+    @tparam Cs The component types to save, they must be
+    trivially copyable.
+*/
+template <class... Cs>
+void save(const registry &reg, std::ostream &out)
+{
+    reg.save<Cs...>(out);
+}
+
+/** Replaces the entities of the registry with those saved
+    by save(). Entity handles are preserved.
+
+    Declared groups adopt the loaded entities, cached ranges
+    are dropped and built again when they are requested.
+
+    @note Ranges obtained before are invalidated.
+
+    @throws runtime_error if the snapshot is truncated,
+    including counts in it that exceed the rest of a seekable
+    stream, or invalid_argument if it is not a snapshot of
+    the same component types.
+
+    @param reg
+
+    @param in Stream to read from, opened in binary mode.
+
+    @tparam Cs The component types, in the same order as
+    they were saved.
+*/
+template <class... Cs>
+void load(registry &reg, std::istream &in)
+{
+    reg.load<Cs...>(in);
+}
+
+/** Writes what changed from baseline to reg to out: the
+    created and destroyed entities, the added and removed
+    components and the changed bytes of the others, XOR and
+    run length encoded.
+
+    Applying the delta to a registry in the state of
+    baseline, e.g. one loaded from a snapshot of it, brings
+    it to the state of reg.
+
+    @throws runtime_error if writing fails.
+
+    @param reg The current state.
+
+    @param baseline The state the delta is relative to.
+
+    @param out Stream to write to, opened in binary mode.
+
+    @tparam Cs The component types to diff, they must be
+    trivially copyable.
+*/
+template <class... Cs>
+void encode_delta(const registry &reg, const registry &baseline,
+    std::ostream &out)
+{
+    reg.encode_delta<Cs...>(baseline, out);
+}
+
+/** Applies a delta written by encode_delta().
+
+    The whole delta is read and checked before reg is
+    changed, so reg is left as it was if it throws one of
+    the exceptions below.
+
+    @throws runtime_error if the delta is truncated or
+    invalid_argument if it was not encoded for the same
+    component types or reg is not in the state of the
+    baseline.
+
+    @param reg Registry in the state of the baseline.
+
+    @param in Stream to read from, opened in binary mode.
+
+    @tparam Cs The component types, in the same order as
+    they were encoded.
+*/
+template <class... Cs>
+void apply_delta(registry &reg, std::istream &in)
+{
+    reg.apply_delta<Cs...>(in);
+}
+
+/** Copies the registry, e.g. to roll back to it or to
+    simulate ahead. Entity handles stay the same and every
+    component keeps its position, so trivially copyable
+    components are copied block by block and cached ranges
+    and groups are copied instead of rebuilt.
+
+    @throws logic_error if a component or singleton is not
+    copyable.
+
+    @param reg
+
+    @return A registry independent of reg, which allocates
+    from the same memory resource. The tables that map the
+    components of reg to their copies are temporary and
+    allocated with the global operator new.
+*/
+inline registry clone(const registry &reg)
+{
+    return reg.clone();
+}
+
+/** Returns the memory used by the registry: per component
+    storage its size, capacity, blocks, bytes and how many
+    blocks hold how many components, the components owned
+    by groups, the rows of cached ranges, and the
+    bookkeeping of the entities.
+
+    Sizes of node based containers are estimates.
+
+    @param reg
+*/
+inline registry_stats stats(const registry &reg)
+{
+    return reg.stats();
+}
+
+/** Writes the entities with all of Cs and these components
+    to out, in a layout that baked_segment maps into memory
+    and uses in place. Entities keep their handles.
+
+    Use it to prepare static content, e.g. the props of a
+    level, which is then loaded without creating entities.
+
+    @throws runtime_error if writing fails.
+
+    @param reg
+
+    @param out Stream to write to, opened in binary mode.
+
+    @tparam Cs The component types to bake.
+*/
+template <class... Cs>
+void bake(const registry &reg, std::ostream &out)
+{
+    reg.bake<Cs...>(out);
+}
+
+/** Reserves the handles of the baked entities, so entities
+    created in reg do not reuse them. The baked entities
+    themselves are accessed through the segment, e.g. with
+    range(segment), while dynamic entities live in reg.
+
+    @throws logic_error if reg has an entity with a baked
+    handle.
+
+    @param reg
+
+    @param segment
+*/
+inline void attach(registry &reg, const baked_segment &segment)
+{
+    reg.attach(segment);
+}
+
+/** Records every structural change of the registry in the
+    journal: create(), destroy(), destroy_if(), emplace(),
+    remove() and clear(). Writes to components are recorded
+    when they are flagged with mark_written(). Replaying the
+    journal with replay() on a registry in the state reg was
+    in when the journal was set, e.g. loaded from a
+    snapshot, restores the state of reg, including handles.
+
+    Singletons are not recorded. A journaled registry can
+    neither be loaded nor have a delta applied.
+
+    @note Components created while a journal is set must be
+    trivially copyable, or logic_error is thrown.
+
+    @param reg
+
+    @param journal The journal, which must outlive its use
+    by reg, or nullptr to stop recording.
+*/
+inline void set_journal(registry &reg, journal *journal) noexcept
+{
+    reg.set_journal(journal);
+}
+
+/** Records the current value of the component in the
+    journal of the registry, if one is set.
+
+    @throws out_of_range if the entity does not exist or
+    invalid_argument if it has no component of type C.
+
+    @param reg
+
+    @param ent The entity whose component was written.
+
+    @tparam C The component type.
+*/
+template <class C>
+void mark_written(registry &reg, handle_type ent)
+{
+    reg.mark_written<C>(ent);
+}
+
+/** Applies the records of a journal to the registry. A
+    record cut off at the end, e.g. by a crash, ends the
+    replay without changing the registry.
+
+    @throws invalid_argument if in is not a journal, was
+    recorded with other component types or does not match
+    the state of reg, and logic_error if reg has a journal.
+
+    @param reg
+
+    @param in Stream to read the journal from, opened in
+    binary mode.
+
+    @tparam Cs The component types recorded in the journal.
+
+    @return The number of records applied.
+*/
+template <class... Cs>
+size_t replay(registry &reg, std::istream &in)
+{
+    return reg.replay<Cs...>(in);
+}
+
+/** Defers the updates of cached ranges. While enabled,
+    create(), emplace() and destroy() only record which
+    entities join or leave a range and the range is updated
+    in a single pass the next time it is requested. Ranges
+    that are not requested pay nothing for the changes.
+
+    Disabling it updates all ranges. Disabled by default.
+
+    @note Ranges obtained before are not updated until
+    they are requested again.
+
+    @param reg
+
+    @param defer
+*/
+inline void defer_range_updates(registry &reg, bool defer)
+{
+    reg.defer_range_updates(defer);
+}
+
+/** Freezes the structure of the registry, so other threads
+    can read it concurrently, e.g. to extract render data.
+    While frozen, get(), contains(), singleton(), each(),
+    group() and range() of ranges built before are safe to
+    use from several threads. Functions that change entities,
+    components, ranges or groups throw logic_error.
+
+    Component values may still be written. Guard types that
+    are written by one thread and read by another with
+    read_lock() and write_lock().
+
+    @note Pending range updates are applied first. Ranges
+    that are not built yet cannot be requested while frozen,
+    prebuild them. Range usage is not recorded while frozen.
+
+    @param reg
+*/
+inline void freeze(registry &reg)
+{
+    reg.freeze();
+}
+
+/** Ends the frozen phase, after all readers are done.
+
+    @param reg
+*/
+inline void thaw(registry &reg) noexcept
+{
+    reg.thaw();
+}
+
+/** Locks the components of the types Cs for reading. Other
+    readers of these types proceed, writers wait. Types are
+    locked in a fixed order, lock all types of one thread in
+    a single call.
+
+    The locks are opt-in: nothing in the registry takes them,
+    so they only order threads that all lock the types they
+    use. They guard component values, not the structure of
+    the registry, which needs freeze().
+
+    @param reg
+
+    @tparam Cs The component types to read.
+
+    @return The locks, released when destroyed.
+*/
+template <class... Cs>
+auto read_lock(const registry &reg)
+{
+    return reg.read_lock<Cs...>();
+}
+
+/** Locks the components of the types Cs for writing, see
+    read_lock().
+
+    @param reg
+
+    @tparam Cs The component types to write.
+
+    @return The locks, released when destroyed.
+*/
+template <class... Cs>
+auto write_lock(const registry &reg)
+{
+    return reg.write_lock<Cs...>();
+}
+
+/** Advances the registry by one tick, e.g. once per frame,
+    and evicts the ranges that went unused for too long.
+
+    The next values of double_buffered components become
+    their current values.
+
+    @note Ranges obtained before may be invalidated.
+
+    @param reg
+*/
+inline void tick(registry &reg)
+{
+    reg.tick();
+}
+
+/** Returns the number of ticks so far, which selects the
+    buffers of double_buffered components, see
+    double_buffered::prev and double_buffered::next.
+
+    @param reg
+*/
+inline size_t current_tick(const registry &reg) noexcept
+{
+    return reg.current_tick();
+}
+
 /** Returns a reference to the component that is added to
     the entity.
 
@@ -156,6 +810,25 @@ C &emplace(registry &reg, handle_type ent, Args &&...args)
     return reg.emplace<C>(ent, std::forward<Args>(args)...);
 }
 
+/** Destroys the component of type C of an entity, the
+    entity itself is kept.
+
+    @throws out_of_range if the entity does not exist or
+    invalid_argument if the entity is not associated with
+    the specified component.
+
+    @param reg
+
+    @param ent The entity that owns the component.
+
+    @tparam C The type of the component.
+*/
+template <class C>
+void remove(registry &reg, handle_type ent)
+{
+    reg.remove<C>(ent);
+}
+
 /** Returns a reference to a singleton.
     
     Every registry can only store a single instance of every
@@ -271,5 +944,38 @@ C &sibling(registry &reg, const F &component)
     return reg.sibling<C>(component);
 }
 
+/** Packs the components of all types densely, releases the
+    memory that is no longer needed and sorts the rows of all
+    ranges by the addresses of their components.
+
+    Meant to be run in quiet periods, e.g. between levels,
+    after lots of entities were created and destroyed.
+
+    @note Components are moved, references and ranges
+    obtained before are invalidated.
+
+    @param reg
+*/
+inline void optimize(registry &reg)
+{
+    reg.optimize();
+}
+
+/** Like optimize(), but only for the components of the
+    specified types and the ranges that include them.
+
+    @note Components are moved, references and ranges
+    obtained before are invalidated.
+
+    @param reg
+
+    @tparam Cs The component types to compact.
+*/
+template <class... Cs>
+void compact(registry &reg)
+{
+    reg.compact<Cs...>();
+}
+
 } // namespace ecs
 
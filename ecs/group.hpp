@@ -0,0 +1,500 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <ecs/component.hpp>
+#include <ecs/detail/memory.hpp>
+#include <ecs/detail/types.hpp>
+#include <ecs/stats.hpp>
+#include <ecs/view.hpp>
+
+namespace ecs {
+namespace detail {
+
+// type erased interface of an owning group, see group<Cs...>
+class basic_group {
+public:
+    // called with the owner, old and new address of every
+    // component of another entity that is moved
+    using relocate_fn = std::function<
+            void(handle_type, void *, void *)>;
+    // moves the component at the address out of the group,
+    // called with its type hash, returns the new address
+    using move_fn = std::function<void *(size_t, void *)>;
+
+    virtual ~basic_group() = default;
+
+    const std::pmr::unordered_set<size_t> &types() const noexcept
+    {
+        return types_;
+    }
+
+    bool captures(const component_set &comps) const noexcept
+    {
+        for (const auto hash : types_) {
+            if (!comps.contains({ hash, 0 }))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual size_t size() const noexcept = 0;
+    virtual void *data(size_t hash) noexcept = 0;
+    virtual group_stats stats() const = 0;
+    virtual const std::pmr::vector<handle_type> &entities()
+            const noexcept = 0;
+    virtual bool contains(const component_set &comps) const noexcept = 0;
+
+    // moves the captured components of comps to the back
+    // of the group and points comps to them. Releasing the
+    // moved-from components is left to the caller
+    virtual void insert(handle_type ent, const component_set &comps,
+            const relocate_fn &relocate) = 0;
+
+    // moves the components of comps out of the group and
+    // points comps to them, the last entity of the group
+    // takes their place
+    virtual void leave(const component_set &comps,
+            const move_fn &move_out, const relocate_fn &relocate) = 0;
+
+    // destroys all components in the group
+    virtual void clear() noexcept = 0;
+
+    // copy of the group with the same capacity, throws
+    // std::logic_error if a component is not copyable
+    virtual pmr_ptr<basic_group> clone(
+            std::pmr::memory_resource *resource) const = 0;
+    // address of the copy of the component of type hash at
+    // ptr in copy, a clone of this group, nullptr if the
+    // component is not in the group
+    virtual void *translate(basic_group &copy, size_t hash,
+            const void *ptr) const noexcept = 0;
+
+    // destroys the components of comps, the last entity of
+    // the group takes their place
+    virtual void erase(const component_set &comps,
+            const relocate_fn &relocate) = 0;
+
+protected:
+    explicit basic_group(std::pmr::memory_resource *resource)
+        : types_(resource)
+    {
+    }
+
+    std::pmr::unordered_set<size_t> types_;
+};
+
+// dense storage for entities that own all Cs, the i-th
+// element of every array belongs to the i-th entity
+template <class... Cs>
+class group final : public basic_group {
+    static_assert(pairwise_distinct<Cs...>);
+    static_assert((std::is_move_constructible_v<Cs> && ...)
+            && (std::is_move_assignable_v<Cs> && ...),
+            "grouped components are moved around");
+public:
+    explicit group(std::pmr::memory_resource *resource);
+
+    size_t size() const noexcept override;
+    void *data(size_t hash) noexcept override;
+    group_stats stats() const override;
+    const std::pmr::vector<handle_type> &entities()
+            const noexcept override;
+    bool contains(const component_set &comps) const noexcept override;
+
+    void insert(handle_type ent, const component_set &comps,
+            const relocate_fn &relocate) override;
+    void erase(const component_set &comps,
+            const relocate_fn &relocate) override;
+    void leave(const component_set &comps,
+            const move_fn &move_out, const relocate_fn &relocate) override;
+    void clear() noexcept override;
+
+    pmr_ptr<basic_group> clone(
+            std::pmr::memory_resource *resource) const override;
+    void *translate(basic_group &copy, size_t hash,
+            const void *ptr) const noexcept override;
+
+private:
+    template <class C>
+    std::pmr::vector<C> &array() noexcept
+    {
+        return std::get<std::pmr::vector<C>>(components_);
+    }
+
+    template <class C>
+    const std::pmr::vector<C> &array() const noexcept
+    {
+        return std::get<std::pmr::vector<C>>(components_);
+    }
+
+    template <class C>
+    static C *find(const component_set &comps) noexcept
+    {
+        return static_cast<C *>(comps.find(
+                { type_hash<C>(), 0 })->ptr);
+    }
+
+    size_t position(const component_set &comps) noexcept;
+    void remove(size_t pos, const relocate_fn &relocate);
+    void grow(const relocate_fn &relocate);
+
+    std::pmr::vector<handle_type> entities_;
+    std::tuple<std::pmr::vector<Cs>...> components_;
+};
+
+} // namespace detail
+
+namespace groups {
+
+template <class... Cs>
+class iterator {
+    static constexpr auto count = sizeof...(Cs);
+public:
+    iterator(std::array<void *, count> pos);
+
+    bool operator==(const iterator &rhs) const noexcept;
+    view<Cs...> &operator*();
+    iterator operator++();
+    iterator operator++(int);
+
+private:
+    // current element of every array
+    std::array<void *, count> pos_;
+
+    // see views::iterator, but the arrays are in order
+    view<Cs...> view_;
+    std::array<size_t, count> order_;
+};
+
+} // namespace groups
+
+template <class... Cs>
+class group_range {
+public:
+    group_range(detail::basic_group &group);
+
+    groups::iterator<Cs...> begin() noexcept;
+    groups::iterator<Cs...> end() noexcept;
+
+    size_t size() const noexcept;
+
+private:
+    detail::basic_group &group_;
+};
+
+namespace detail {
+
+template <class... Cs>
+group<Cs...>::group(std::pmr::memory_resource *resource)
+    : basic_group(resource)
+    , entities_(resource)
+    , components_(std::pmr::vector<Cs>(resource)...)
+{
+    (types_.emplace(type_hash<Cs>()), ...);
+}
+
+template <class... Cs>
+size_t group<Cs...>::size() const noexcept
+{
+    return entities_.size();
+}
+
+template <class... Cs>
+group_stats group<Cs...>::stats() const
+{
+    group_stats out;
+    out.types = { type_hash<Cs>()... };
+    out.size = size();
+    out.capacity = entities_.capacity();
+    out.bytes = entities_.capacity() * sizeof(handle_type)
+        + ((array<Cs>().capacity() * sizeof(Cs)) + ...);
+    return out;
+}
+
+template <class... Cs>
+const std::pmr::vector<handle_type> &group<Cs...>::entities()
+    const noexcept
+{
+    return entities_;
+}
+
+template <class... Cs>
+void *group<Cs...>::data(size_t hash) noexcept
+{
+    void *ptr = nullptr;
+    (..., (hash == type_hash<Cs>()
+        ? void(ptr = array<Cs>().data()) : void()));
+    return ptr;
+}
+
+template <class... Cs>
+bool group<Cs...>::contains(const component_set &comps) const noexcept
+{
+    using head = head_type<Cs...>;
+
+    const auto it = comps.find({ type_hash<head>(), 0 });
+    if (it == comps.end())
+        return false;
+
+    const auto &arr = std::get<std::pmr::vector<head>>(components_);
+    const auto ptr = static_cast<const head *>(it->ptr);
+    return ptr >= arr.data() && ptr < arr.data() + arr.size();
+}
+
+template <class... Cs>
+void group<Cs...>::insert(handle_type ent,
+    const component_set &comps, const relocate_fn &relocate)
+{
+    if (entities_.size() == entities_.capacity())
+        grow(relocate);
+
+    entities_.push_back(ent);
+
+    const auto move_in = [&](auto t)
+    {
+        using type = typename decltype(t)::type;
+
+        auto &arr = array<type>();
+        arr.push_back(std::move(*find<type>(comps)));
+        comps.find({ type_hash<type>(), 0 })->ptr = &arr.back();
+    };
+
+    (..., move_in(std::type_identity<Cs>{}));
+}
+
+template <class... Cs>
+void group<Cs...>::erase(const component_set &comps,
+    const relocate_fn &relocate)
+{
+    remove(position(comps), relocate);
+}
+
+template <class... Cs>
+void group<Cs...>::leave(const component_set &comps,
+    const move_fn &move_out, const relocate_fn &relocate)
+{
+    const auto pos = position(comps);
+
+    const auto move = [&](auto t)
+    {
+        using type = typename decltype(t)::type;
+
+        comps.find({ type_hash<type>(), 0 })->ptr
+            = move_out(type_hash<type>(), &array<type>()[pos]);
+    };
+
+    (..., move(std::type_identity<Cs>{}));
+
+    remove(pos, relocate);
+}
+
+template <class... Cs>
+void group<Cs...>::clear() noexcept
+{
+    entities_.clear();
+    (..., array<Cs>().clear());
+}
+
+template <class... Cs>
+pmr_ptr<basic_group> group<Cs...>::clone(
+    std::pmr::memory_resource *resource) const
+{
+    if constexpr ((std::is_copy_constructible_v<Cs> && ...)) {
+        auto copy = make_pmr<group>(resource, resource);
+
+        // same capacity, so the copy grows at the same time
+        copy->entities_.reserve(entities_.capacity());
+        copy->entities_ = entities_;
+
+        const auto copy_array = [&](auto t)
+        {
+            using type = typename decltype(t)::type;
+
+            auto &arr = copy->template array<type>();
+            arr.reserve(entities_.capacity());
+            arr.insert(arr.end(), array<type>().begin(),
+                    array<type>().end());
+        };
+
+        (..., copy_array(std::type_identity<Cs>{}));
+
+        return copy;
+    } else {
+        throw std::logic_error("component is not copyable");
+    }
+}
+
+template <class... Cs>
+void *group<Cs...>::translate(basic_group &copy, size_t hash,
+    const void *ptr) const noexcept
+{
+    void *result = nullptr;
+
+    const auto locate = [&](auto t)
+    {
+        using type = typename decltype(t)::type;
+
+        if (hash != type_hash<type>())
+            return;
+
+        const auto &arr = array<type>();
+        const auto comp = static_cast<const type *>(ptr);
+        if (!std::less<>{}(comp, arr.data())
+            && std::less<>{}(comp, arr.data() + arr.size()))
+        {
+            result = static_cast<group &>(copy).template array<type>()
+                .data() + (comp - arr.data());
+        }
+    };
+
+    (..., locate(std::type_identity<Cs>{}));
+
+    return result;
+}
+
+template <class... Cs>
+size_t group<Cs...>::position(const component_set &comps) noexcept
+{
+    using head = head_type<Cs...>;
+
+    return static_cast<size_t>(
+            find<head>(comps) - array<head>().data());
+}
+
+template <class... Cs>
+void group<Cs...>::remove(size_t pos, const relocate_fn &relocate)
+{
+    const auto last = entities_.size() - 1;
+
+    const auto swap_out = [&](auto t)
+    {
+        using type = typename decltype(t)::type;
+
+        auto &arr = array<type>();
+        if (pos != last) {
+            arr[pos] = std::move(arr[last]);
+            relocate(entities_[last], &arr[last], &arr[pos]);
+        }
+        arr.pop_back();
+    };
+
+    (..., swap_out(std::type_identity<Cs>{}));
+
+    entities_[pos] = entities_[last];
+    entities_.pop_back();
+}
+
+template <class... Cs>
+void group<Cs...>::grow(const relocate_fn &relocate)
+{
+    // all arrays share the same capacity, so they are
+    // reallocated together and only here
+    const auto capacity = std::max(16uz, entities_.capacity() * 2);
+    entities_.reserve(capacity);
+
+    const auto reallocate = [&](auto t)
+    {
+        using type = typename decltype(t)::type;
+
+        auto &arr = array<type>();
+        std::pmr::vector<type> grown(arr.get_allocator());
+        grown.reserve(capacity);
+        for (auto i = 0uz; i < arr.size(); ++i) {
+            grown.push_back(std::move(arr[i]));
+            relocate(entities_[i], &arr[i], &grown.back());
+        }
+        arr = std::move(grown);
+    };
+
+    (..., reallocate(std::type_identity<Cs>{}));
+}
+
+} // namespace detail
+
+template <class... Cs>
+group_range<Cs...>::group_range(detail::basic_group &group)
+    : group_(group)
+{
+}
+
+template <class... Cs>
+groups::iterator<Cs...> group_range<Cs...>::begin() noexcept
+{
+    return groups::iterator<Cs...>({
+            group_.data(detail::type_hash<Cs>())... });
+}
+
+template <class... Cs>
+groups::iterator<Cs...> group_range<Cs...>::end() noexcept
+{
+    const auto size = group_.size();
+    return groups::iterator<Cs...>({ static_cast<void *>(
+            static_cast<Cs *>(group_.data(
+                    detail::type_hash<Cs>())) + size)... });
+}
+
+template <class... Cs>
+size_t group_range<Cs...>::size() const noexcept
+{
+    return group_.size();
+}
+
+namespace groups {
+
+template <class... Cs>
+iterator<Cs...>::iterator(std::array<void *, count> pos)
+    : pos_(pos)
+    , view_(nullptr, nullptr)
+{
+    for (auto i = 0uz; i < count; ++i)
+        order_[i] = i;
+}
+
+template <class... Cs>
+bool iterator<Cs...>::operator==(const iterator &rhs) const noexcept
+{
+    return pos_[0] == rhs.pos_[0];
+}
+
+template <class... Cs>
+view<Cs...> &iterator<Cs...>::operator*()
+{
+    view_ = view<Cs...>(order_.data(), pos_.data());
+    return view_;
+}
+
+template <class... Cs>
+iterator<Cs...> iterator<Cs...>::operator++()
+{
+    [this]<size_t... Is>(std::index_sequence<Is...>)
+    {
+        (..., (pos_[Is] = static_cast<
+                std::remove_const_t<Cs> *>(pos_[Is]) + 1));
+    }(std::index_sequence_for<Cs...>{});
+
+    return *this;
+}
+
+template <class... Cs>
+iterator<Cs...> iterator<Cs...>::operator++(int)
+{
+    iterator temp(*this);
+    ++*this;
+    return temp;
+}
+
+} // namespace groups
+} // namespace ecs
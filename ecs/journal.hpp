@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace ecs {
+
+// append-only record of the structural changes of a
+// registry, see registry::set_journal. The registry copies
+// the records into a ring buffer, which a background thread
+// writes to the stream
+class journal {
+public:
+    enum class op : std::uint8_t {
+        create,
+        destroy,
+        emplace,
+        remove,
+        write,
+        clear,
+        clear_type,
+    };
+
+    static constexpr std::uint32_t magic = 0x4a534345; // ECSJ
+    // version 2 identifies types by persistent_id
+    static constexpr std::uint32_t version = 2;
+    static constexpr size_t default_capacity = 1uz << 20;
+    // longest time a record stays in the buffer
+    static constexpr auto flush_interval = std::chrono::milliseconds(10);
+
+    // capacity is rounded up to a power of two
+    explicit journal(std::ostream &out,
+            size_t capacity = default_capacity);
+    journal(const journal &) = delete;
+    journal &operator=(const journal &) = delete;
+    // writes the remaining records
+    ~journal();
+
+    // blocks only while the buffer is full
+    void write(const void *data, size_t size);
+    // returns once all records so far are written
+    void flush();
+
+private:
+    void run();
+    void check() const;
+
+    std::ostream &out_;
+    std::vector<std::byte> ring_;
+    size_t mask_;
+
+    // bytes ever written and ever consumed, on separate
+    // cache lines since they are written by different threads
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) std::atomic<size_t> tail_ = 0;
+
+    std::atomic<bool> stop_ = false;
+    std::atomic<bool> failed_ = false;
+    std::mutex mutex_;
+    std::condition_variable data_;
+    std::condition_variable space_;
+    std::thread writer_;
+};
+
+inline journal::journal(std::ostream &out, size_t capacity)
+    : out_(out)
+    , ring_(std::bit_ceil(std::max(capacity, 64uz)))
+    , mask_(ring_.size() - 1)
+{
+    out_.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    out_.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    if (!out_)
+        throw std::runtime_error("failed to write journal");
+
+    writer_ = std::thread([this] { run(); });
+}
+
+inline journal::~journal()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    data_.notify_one();
+    writer_.join();
+}
+
+inline void journal::write(const void *data, size_t size)
+{
+    check();
+
+    auto src = static_cast<const std::byte *>(data);
+    auto head = head_.load(std::memory_order_relaxed);
+
+    while (size > 0) {
+        const auto used = head - tail_.load(std::memory_order_acquire);
+        if (used == ring_.size()) {
+            std::unique_lock lock(mutex_);
+            data_.notify_one();
+            space_.wait(lock, [&]
+            {
+                return failed_ || head - tail_.load(
+                        std::memory_order_acquire) < ring_.size();
+            });
+            check();
+            continue;
+        }
+
+        const auto offset = head & mask_;
+        const auto count = std::min({ size, ring_.size() - used,
+                ring_.size() - offset });
+        std::memcpy(ring_.data() + offset, src, count);
+
+        head += count;
+        src += count;
+        size -= count;
+        head_.store(head, std::memory_order_release);
+    }
+
+    // wake the writer early, before the buffer fills up
+    if (head - tail_.load(std::memory_order_relaxed) > ring_.size() / 2)
+        data_.notify_one();
+}
+
+inline void journal::flush()
+{
+    std::unique_lock lock(mutex_);
+    const auto head = head_.load(std::memory_order_relaxed);
+    data_.notify_one();
+    space_.wait(lock, [&]
+    {
+        return failed_ || tail_.load(std::memory_order_acquire) == head;
+    });
+    check();
+}
+
+inline void journal::check() const
+{
+    if (failed_)
+        throw std::runtime_error("failed to write journal");
+}
+
+inline void journal::run()
+{
+    for (;;) {
+        {
+            std::unique_lock lock(mutex_);
+            data_.wait_for(lock, flush_interval, [this]
+            {
+                return stop_ || head_.load(std::memory_order_acquire)
+                    != tail_.load(std::memory_order_relaxed);
+            });
+        }
+
+        const auto head = head_.load(std::memory_order_acquire);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (head == tail) {
+            if (stop_)
+                return;
+            continue;
+        }
+
+        while (tail != head) {
+            const auto offset = tail & mask_;
+            const auto count = std::min(head - tail,
+                    ring_.size() - offset);
+            out_.write(reinterpret_cast<const char *>(
+                        ring_.data() + offset), count);
+            tail += count;
+        }
+        out_.flush();
+
+        {
+            std::lock_guard lock(mutex_);
+            if (!out_)
+                failed_ = true;
+            tail_.store(tail, std::memory_order_release);
+        }
+        space_.notify_all();
+
+        if (failed_)
+            return;
+    }
+}
+
+} // namespace ecs
@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ECS_PERF_EVENTS 1
+#endif
+
+namespace ecs::perf {
+
+enum class counter : std::uint8_t {
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+};
+
+constexpr size_t counter_count = 5;
+
+constexpr std::array<std::string_view, counter_count> counter_names{
+    "cycles", "instructions", "L1d misses", "LLC misses", "branch misses",
+};
+
+// counts of a system summed over its calls
+struct totals {
+    size_t calls = 0;
+    // nullopt for counters that could not be opened, e.g.
+    // in a container without access to perf events
+    std::array<std::optional<std::uint64_t>, counter_count> counts;
+
+    std::optional<std::uint64_t> operator[](counter c) const noexcept
+    {
+        return counts[static_cast<size_t>(c)];
+    }
+};
+
+namespace detail {
+
+// the counters of the calling thread, opened on first use.
+// They count user space only, which needs no privileges
+// under the default perf_event_paranoid setting
+class thread_counters {
+public:
+    struct reading {
+        // counted events, time enabled and time running, the
+        // latter differ when the kernel multiplexes counters
+        std::array<std::uint64_t, counter_count> value{};
+        std::array<std::uint64_t, counter_count> enabled{};
+        std::array<std::uint64_t, counter_count> running{};
+    };
+
+    thread_counters();
+    thread_counters(const thread_counters &) = delete;
+    thread_counters &operator=(const thread_counters &) = delete;
+    ~thread_counters();
+
+    bool available(size_t index) const noexcept
+    {
+        return fds_[index] >= 0;
+    }
+    reading read() const noexcept;
+
+private:
+    std::array<int, counter_count> fds_;
+};
+
+inline thread_counters::thread_counters()
+{
+    fds_.fill(-1);
+
+#ifdef ECS_PERF_EVENTS
+    constexpr auto cache = [](std::uint64_t id, std::uint64_t result)
+    {
+        return id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+    };
+
+    const std::array<std::pair<std::uint32_t, std::uint64_t>,
+            counter_count> events{ {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D,
+                PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    } };
+
+    for (auto i = 0uz; i < counter_count; ++i) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = events[i].first;
+        attr.config = events[i].second;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // fails with ENOSYS, EACCES or ENOENT where perf events
+        // are unavailable, the counter is then left out
+        fds_[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr,
+                0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+#endif
+}
+
+inline thread_counters::~thread_counters()
+{
+#ifdef ECS_PERF_EVENTS
+    for (const auto fd : fds_) {
+        if (fd >= 0)
+            ::close(fd);
+    }
+#endif
+}
+
+inline thread_counters::reading thread_counters::read() const noexcept
+{
+    reading out;
+
+#ifdef ECS_PERF_EVENTS
+    for (auto i = 0uz; i < counter_count; ++i) {
+        std::uint64_t data[3];
+        if (fds_[i] < 0 || ::read(fds_[i], data, sizeof(data))
+                != static_cast<ssize_t>(sizeof(data)))
+        {
+            continue;
+        }
+
+        out.value[i] = data[0];
+        out.enabled[i] = data[1];
+        out.running[i] = data[2];
+    }
+#endif
+
+    return out;
+}
+
+inline thread_counters &local_counters()
+{
+    thread_local thread_counters counters;
+    return counters;
+}
+
+} // namespace detail
+
+// aggregates the hardware counters of systems or scopes by
+// name. A scope is measured on the thread it runs on and must
+// end there. Linux only, elsewhere and where perf events are
+// unavailable only the calls are counted
+class profiler {
+public:
+    class scope {
+    public:
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+        ~scope();
+
+    private:
+        friend class profiler;
+
+        scope(profiler &prof, std::string_view name);
+
+        profiler &prof_;
+        std::string_view name_;
+        detail::thread_counters::reading begin_;
+    };
+
+    // measures until the returned scope is destroyed, name
+    // must outlive it
+    [[nodiscard]] scope measure(std::string_view name);
+
+    // measures a call of a system
+    template <class F, class... Args>
+    decltype(auto) run(std::string_view name, F &&fn, Args &&...args);
+
+    // whether any counter is available on the calling thread
+    bool available() const;
+
+    std::map<std::string, totals, std::less<>> results() const;
+    // one line per system with the counts per call
+    void report(std::ostream &out) const;
+    void clear();
+
+private:
+    void add(std::string_view name,
+            const detail::thread_counters::reading &begin,
+            const detail::thread_counters::reading &end);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, totals, std::less<>> totals_;
+};
+
+inline profiler::scope::scope(profiler &prof, std::string_view name)
+    : prof_(prof)
+    , name_(name)
+    , begin_(detail::local_counters().read())
+{
+}
+
+inline profiler::scope::~scope()
+{
+    prof_.add(name_, begin_, detail::local_counters().read());
+}
+
+inline profiler::scope profiler::measure(std::string_view name)
+{
+    return scope(*this, name);
+}
+
+template <class F, class... Args>
+decltype(auto) profiler::run(std::string_view name, F &&fn,
+    Args &&...args)
+{
+    const auto measured = measure(name);
+    return std::invoke(std::forward<F>(fn), std::forward<Args>(args)...);
+}
+
+inline bool profiler::available() const
+{
+    const auto &counters = detail::local_counters();
+    for (auto i = 0uz; i < counter_count; ++i) {
+        if (counters.available(i))
+            return true;
+    }
+
+    return false;
+}
+
+inline void profiler::add(std::string_view name,
+    const detail::thread_counters::reading &begin,
+    const detail::thread_counters::reading &end)
+{
+    const auto &counters = detail::local_counters();
+
+    std::lock_guard lock(mutex_);
+    auto it = totals_.find(name);
+    if (it == totals_.end())
+        it = totals_.emplace(std::string(name), totals{}).first;
+
+    auto &sums = it->second;
+    ++sums.calls;
+
+    for (auto i = 0uz; i < counter_count; ++i) {
+        if (!counters.available(i))
+            continue;
+
+        // scale by the share of the time the counter was
+        // actually counting
+        const auto value = end.value[i] - begin.value[i];
+        const auto enabled = end.enabled[i] - begin.enabled[i];
+        const auto running = end.running[i] - begin.running[i];
+        const auto scaled = running == 0 ? 0 : static_cast<std::uint64_t>(
+                static_cast<long double>(value) * enabled / running);
+
+        sums.counts[i] = sums.counts[i].value_or(0) + scaled;
+    }
+}
+
+inline std::map<std::string, totals, std::less<>> profiler::results() const
+{
+    std::lock_guard lock(mutex_);
+    return totals_;
+}
+
+inline void profiler::report(std::ostream &out) const
+{
+    const auto results = this->results();
+
+    out << std::format("{:<24}{:>10}", "system", "calls");
+    for (const auto name : counter_names)
+        out << std::format("{:>16}", name);
+    out << '\n';
+
+    for (const auto &[name, sums] : results) {
+        out << std::format("{:<24}{:>10}", name, sums.calls);
+        for (const auto &count : sums.counts) {
+            if (count)
+                out << std::format("{:>16}", *count / sums.calls);
+            else
+                out << std::format("{:>16}", "n/a");
+        }
+        out << '\n';
+    }
+}
+
+inline void profiler::clear()
+{
+    std::lock_guard lock(mutex_);
+    totals_.clear();
+}
+
+} // namespace ecs::perf
@@ -2,19 +2,48 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <future>
+#include <istream>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <ecs/baked.hpp>
+#include <ecs/buffered.hpp>
 #include <ecs/component.hpp>
+#include <ecs/cursor.hpp>
 #include <ecs/detail/colony.hpp>
+#include <ecs/detail/delta.hpp>
+#include <ecs/detail/handle_counter.hpp>
+#include <ecs/detail/memory.hpp>
+#include <ecs/detail/storage.hpp>
+#include <ecs/detail/stream.hpp>
 #include <ecs/detail/types.hpp>
+#include <ecs/group.hpp>
+#include <ecs/journal.hpp>
+#include <ecs/spawn.hpp>
+#include <ecs/stats.hpp>
+#include <ecs/trace.hpp>
 #include <ecs/view.hpp>
 
 namespace ecs {
@@ -23,7 +52,13 @@ class registry {
     using size_type = size_t;
 
 public:
-    registry() = default;
+    registry();
+    // all memory the registry keeps, including components,
+    // storages and groups, is allocated from resource, which
+    // must outlive it. Scratch memory freed before a call
+    // returns, e.g. the address tables of clone, may still
+    // come from the global heap
+    explicit registry(std::pmr::memory_resource *resource);
     registry(const registry &) = delete;
     registry(registry &&) = default;
     ~registry() = default;
@@ -32,7 +67,16 @@ public:
     handle_type create(Cs &&...args);
     handle_type create();
 
+    // may be called from any thread
+    handle_type reserve_handles(size_type count) noexcept;
+    void publish(spawn_buffer &buffer);
+
     void destroy(handle_type ent);
+    template <class C, class... Cs, class F>
+    size_type destroy_if(F &&pred);
+    void clear();
+    template <class C>
+    void clear();
 
     template <class C>
     C &get(handle_type ent);
@@ -42,11 +86,21 @@ public:
     template <class C, class... Cs>
     auto range();
 
+    template <class C, class... Cs, class F>
+    void each(F &&fn);
+    template <class... Cs, class F>
+    bool resume(range_cursor<Cs...> &cursor, F &&fn,
+            size_type max_entities, std::chrono::nanoseconds budget
+            = std::chrono::nanoseconds::max());
+
     template <class C>
     C &emplace(handle_type ent, C &&arg);
     template <class C, class... Args>
     C &emplace(handle_type ent, Args &&...args);
 
+    template <class C>
+    void remove(handle_type ent);
+
     template <class S>
     S &singleton();
     template <class S>
@@ -63,59 +117,252 @@ public:
     template <class C, detail::FatComponent F>
     C &sibling(const F &comp);
 
+    template <class... Cs>
+    group_range<Cs...> group();
+
+    void optimize();
+    template <class... Cs>
+    void compact();
+
+    template <class C, class... Cs>
+    bool release_range();
+    template <class C, class... Cs>
+    std::optional<range_usage> usage() const;
+    void evict_ranges_after(size_type ticks) noexcept;
+    void tick();
+    size_type current_tick() const noexcept;
+
+    void defer_range_updates(bool defer);
+
+    void freeze();
+    void thaw() noexcept;
+    bool frozen() const noexcept;
+    template <class... Cs>
+    auto read_lock() const;
+    template <class... Cs>
+    auto write_lock() const;
+
+    template <class... Cs>
+    void save(std::ostream &out) const;
+    template <class... Cs>
+    void load(std::istream &in);
+
+    template <class... Cs>
+    void encode_delta(const registry &baseline, std::ostream &out) const;
+    template <class... Cs>
+    void apply_delta(std::istream &in);
+
+    template <class... Tuples>
+    void prebuild();
+
+    registry clone() const;
+
+    registry_stats stats() const;
+
+    template <class... Cs>
+    void bake(std::ostream &out) const;
+    void attach(const baked_segment &segment);
+
+    void set_journal(journal *journal) noexcept;
+    template <class C>
+    void mark_written(handle_type ent);
+    template <class... Cs>
+    size_type replay(std::istream &in);
+
 private:
+    template <class C>
+    friend class detail::stage;
+
+    template <class C>
+    detail::storage<std::remove_cvref_t<C>> &typed_storage();
     template <class C>
     detail::storage_type<C> &storage_for();
 
     template <class... Cs>
     typed_view_range<Cs...> range_for();
+    template <class... Cs>
+    buffered_range<Cs...> buffered_range_for();
+    void build(view_range &range) const;
+    void flush(view_range &range);
+    void flush_ranges();
 
-    template <class C>
-    std::tuple<size_type, std::remove_cvref_t<C> *>
-    construct_component(handle_type owner, C &&comp);
+    size_type candidates(size_type hash) const noexcept;
+    template <class C, class F>
+    void each_candidate(F &&fn);
 
     template <class C>
-    void destroy_component(handle_type ent);
+    std::remove_cvref_t<C> *construct_component(
+            handle_type owner, C &&comp);
+    // adds an entity whose components are constructed
+    void insert(handle_type ent, component_set &&comps,
+            size_type xor_hash);
 
-    using entity_dtor_fn = std::function<
-            void(registry &, handle_type)>;
+    void relocate(const relocation_map &moved);
+    void relocate_views(const relocation_map &moved);
+
+    void adopt(handle_type ent, const component_set &comps,
+            relocation_map &moved);
+    void leave(detail::basic_group &group, handle_type ent,
+            relocation_map &moved);
+
+    void check_thawed() const;
+    template <class Lock, class... Cs>
+    std::array<Lock, sizeof...(Cs)> lock_storages() const;
 
-    entity_dtor_fn placeholder_dtor();
-    template <class... Cs>
-    entity_dtor_fn entity_dtor();
     template <class... Cs>
-    entity_dtor_fn nested_entity_dtor(entity_dtor_fn &&dtor);
+    void check_journaled() const;
+    void journal_write(const auto &...values);
+    template <class C>
+    void journal_component(const C &comp);
+
+    using handle_set = std::pmr::unordered_set<handle_type>;
+    void destroy_all(const handle_set &ents);
+    detail::basic_group::relocate_fn relocate_member(
+            relocation_map &moved);
+
+    struct singleton_entry {
+        std::shared_ptr<void> value;
+        // copies value for a clone, nullptr if not copyable
+        std::shared_ptr<void> (*copy)(const void *,
+                std::pmr::memory_resource *);
+    };
+
+    template <class S>
+    static singleton_entry make_singleton(
+            std::pmr::memory_resource *resource, auto &&...args);
 
     struct entinfo {
-        entinfo(size_t hash, component_set &&comps,
-            entity_dtor_fn dtor)
+        entinfo(size_t hash, component_set &&comps)
             : xor_hash(hash)
             , components(std::move(comps))
-            , dtor(dtor)
         { }
 
         size_t xor_hash;
         component_set components;
-        entity_dtor_fn dtor;
     };
 
-    handle_type max_entity_handle_ = 1uz;
-    std::unordered_map<size_type,
-            std::shared_ptr<void>> components_;
-    std::unordered_map<handle_type, entinfo> entities_;
-    std::unordered_map<size_type, view_range> ranges_;
-    std::unordered_map<size_type,
-            std::shared_ptr<void>> singletons_;
+    static constexpr std::uint32_t snapshot_magic = 0x31534345; // ECS1
+    // version 2 identifies types by persistent_id
+    static constexpr std::uint32_t snapshot_version = 2;
+    static constexpr std::uint32_t delta_magic = 0x44534345; // ECSD
+    static constexpr std::uint32_t delta_version = 2;
+
+    // ranges over fewer entities are built on a single thread
+    static constexpr size_type parallel_build_min = 1uz << 14;
+
+    std::pmr::memory_resource *resource_;
+    // entity map nodes, component sets and relocation maps
+    // are recycled, so creating and destroying entities stops
+    // allocating once the pool has grown to the working set.
+    // Owned by pointer to keep the registry movable
+    detail::pmr_ptr<std::pmr::unsynchronized_pool_resource> pool_
+        = detail::make_pmr<std::pmr::unsynchronized_pool_resource>(
+                resource_, resource_);
+    // row of component pointers, reused by emplace
+    std::pmr::vector<void *> row_{ resource_ };
+
+    detail::handle_counter max_entity_handle_{ 1uz };
+    size_type tick_ = 0;
+    // ranges unused for more ticks are evicted, 0 for never
+    size_type evict_after_ = 0;
+    // ranges are updated when requested, not on every change
+    bool deferred_ = false;
+    // records structural changes, if set
+    journal *journal_ = nullptr;
+    // read paths are safe to use from several threads
+    bool frozen_ = false;
+    std::pmr::unordered_map<size_type,
+            detail::pmr_ptr<detail::basic_storage>> components_{
+            resource_ };
+    std::pmr::unordered_map<handle_type, entinfo> entities_{
+            pool_.get() };
+    std::pmr::unordered_map<size_type, view_range> ranges_{ resource_ };
+    std::pmr::unordered_map<size_type,
+            detail::pmr_ptr<detail::basic_group>> groups_{ resource_ };
+    // component type hash -> group that owns the type
+    std::pmr::unordered_map<size_type,
+            detail::basic_group *> owned_{ resource_ };
+    std::pmr::unordered_map<size_type,
+            singleton_entry> singletons_{ resource_ };
+};
+
+namespace components {
+
+// iterates the components in a colony, followed by those
+// in the group that owns the type, if there is one
+template <class Colony, class T>
+class iterator {
+    using size_type = Colony::size_type;
+public:
+    using value_type = std::remove_const_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator()
+        : colony_(nullptr)
+        , pos_(boost::dynamic_bitset<>::npos)
+        , grouped_(nullptr)
+    {
+    }
+
+    iterator(Colony *colony, size_type pos, T *grouped)
+        : colony_(colony)
+        , pos_(pos)
+        , grouped_(grouped)
+    {
+    }
+
+    iterator &operator++() noexcept
+    {
+        if (pos_ != boost::dynamic_bitset<>::npos)
+            pos_ = colony_->next(pos_);
+        else
+            ++grouped_;
+
+        return *this;
+    }
+
+    iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    T &operator*() const
+    {
+        if (pos_ != boost::dynamic_bitset<>::npos)
+            return colony_->at(pos_);
+
+        return *grouped_;
+    }
+
+    bool operator==(const iterator &other) const noexcept
+    {
+        return pos_ == other.pos_ && grouped_ == other.grouped_;
+    }
+
+private:
+    Colony *colony_;
+    size_type pos_;
+    T *grouped_;
 };
 
+} // namespace components
+
 template <class C>
 class component_range {
+    using value_type = std::remove_cvref_t<C>;
 public:
-    using iterator = detail::storage_type<C>::iterator;
-    using const_iterator = detail::storage_type<C>
-            ::const_iterator;
+    using iterator = components::iterator<
+            detail::storage_type<C>, value_type>;
+    using const_iterator = components::iterator<
+            const detail::storage_type<C>, const value_type>;
 
-    component_range(detail::storage_type<C> &components);
+    component_range(detail::storage_type<C> &components,
+        std::span<value_type> grouped = {});
+    // only the grouped components, for types without a colony
+    explicit component_range(std::span<value_type> grouped);
 
     iterator begin();
     iterator end();
@@ -123,171 +370,614 @@ public:
     const_iterator end() const;
 
 private:
-    detail::storage_type<C> &components_;
+    // nullptr if the type has no colony
+    detail::storage_type<C> *components_;
+    std::span<value_type> grouped_;
 };
 
 } // namespace ecs
 
 namespace ecs {
 
+inline registry::registry()
+    : registry(std::pmr::get_default_resource())
+{
+}
+
+inline registry::registry(std::pmr::memory_resource *resource)
+    : resource_(resource)
+{
+}
+
 template <class... Cs>
 handle_type registry::create(Cs &&...args)
 {
     static_assert(detail::pairwise_distinct<Cs...>);
 
-    const handle_type ent = max_entity_handle_++;
-    auto comps = component_set{};
+    check_thawed();
+    check_journaled<Cs...>();
+
+    const handle_type ent = max_entity_handle_.reserve();
+    auto comps = component_set(pool_.get());
     comps.reserve(sizeof...(Cs));
-    // ptrs to components for constucting views
-    std::unordered_map<size_type, void *> ptrs;
-    ptrs.reserve(sizeof...(Cs));
 
     const auto ctor = [&](auto &&arg)
     {
         using type = std::remove_cvref_t<decltype(arg)>;
         const auto hash = detail::type_hash<type>();
 
-        auto [pos, ptr] = construct_component(ent,
+        auto ptr = construct_component(ent,
                 std::forward<decltype(arg)>(arg));
 
         comps.emplace(hash, ptr);
-        ptrs.emplace(hash, static_cast<void *>(ptr));
     };
 
     (..., ctor(std::forward<Cs>(args)));
 
+    if (journal_ != nullptr) {
+        journal_write(journal::op::create, std::uint64_t(ent),
+                std::uint32_t(sizeof...(Cs)));
+        (..., journal_component(*static_cast<std::remove_cvref_t<Cs> *>(
+                comps.find({ detail::type_hash<Cs>(), 0 })->ptr)));
+    }
+
+    insert(ent, std::move(comps), detail::xor_type_hash<Cs...>());
+
+    return ent;
+}
+
+inline void registry::insert(handle_type ent, component_set &&comps,
+    size_type xor_hash)
+{
+    if (!groups_.empty()) {
+        // the entity has no views yet, nothing to patch
+        relocation_map moved(pool_.get());
+        adopt(ent, comps, moved);
+    }
+
     // update views
-    std::array<void *, sizeof...(Cs)> new_view;
+    row_.resize(comps.size());
 
-    for (auto &[xor_hash, range] : ranges_) {
+    for (auto &[key, range] : ranges_) {
         if (!range.captures(comps)) {
             continue;
         }
 
+        if (deferred_) {
+            range.pending_add.push_back(ent);
+            continue;
+        }
+
         // add entity to the range
-        auto it = std::begin(new_view);
-        
+        auto it = row_.data();
         for (const size_t hash : range.types) {
-            *it++ = ptrs.at(hash);
+            *it++ = comps.find({ hash, 0 })->ptr;
         }
 
         range.push_back(ent, std::span(
-                new_view.data(), std::size(range)));
+                row_.data(), std::size(range)));
     }
 
-    const auto xor_hash = detail::xor_type_hash<Cs...>();
     entities_.emplace(ent,
-            entinfo(xor_hash, std::move(comps),
-                entity_dtor<Cs...>()));
-
-    return ent;
+            entinfo(xor_hash, std::move(comps)));
 }
 
 inline handle_type registry::create()
 {
-    const handle_type ent = max_entity_handle_++;
+    check_thawed();
+
+    const handle_type ent = max_entity_handle_.reserve();
     const auto xor_hash = 0uz;
 
-    entities_.emplace(ent, entinfo(xor_hash, component_set{},
-            placeholder_dtor()));
+    entities_.emplace(ent,
+            entinfo(xor_hash, component_set(pool_.get())));
+
+    if (journal_ != nullptr) {
+        journal_write(journal::op::create, std::uint64_t(ent),
+                std::uint32_t(0));
+    }
 
     return ent;
 }
 
+inline handle_type registry::reserve_handles(size_type count) noexcept
+{
+    return max_entity_handle_.reserve(count);
+}
+
+inline void registry::publish(spawn_buffer &buffer)
+{
+    check_thawed();
+
+    auto &staged = buffer.entities_;
+    auto next = staged.begin();
+
+    // the entities published so far and the one that failed
+    // leave the buffer, so none is published twice
+    try {
+        for (; next != staged.end(); ++next) {
+            const auto first = buffer.components_.begin() + next->first;
+            const auto last = first + next->count;
+
+            if (journal_ != nullptr) {
+                for (auto it = first; it != last; ++it)
+                    it->first->check_journaled(*this);
+            }
+
+            auto comps = component_set(pool_.get());
+            comps.reserve(next->count);
+
+            auto it = first;
+            try {
+                for (; it != last; ++it) {
+                    const auto [stage, index] = *it;
+                    comps.emplace(stage->hash(),
+                            stage->publish(*this, next->ent, index));
+                }
+            } catch (...) {
+                for (auto done = first; done != it; ++done) {
+                    done->first->unpublish(*this,
+                            comps.find({ done->first->hash(), 0 })->ptr);
+                }
+                throw;
+            }
+
+            if (journal_ != nullptr) {
+                journal_write(journal::op::create, std::uint64_t(next->ent),
+                        std::uint32_t(next->count));
+                for (const auto &[stage, index] : std::ranges::subrange(
+                        first, last))
+                {
+                    stage->journal(*this,
+                            comps.find({ stage->hash(), 0 })->ptr);
+                }
+            }
+
+            insert(next->ent, std::move(comps), next->xor_hash);
+        }
+    } catch (...) {
+        staged.erase(staged.begin(), next == staged.end() ? next : next + 1);
+        throw;
+    }
+
+    buffer.clear();
+}
+
+inline void spawn_buffer::refill() noexcept
+{
+    next_ = reg_.reserve_handles(batch_);
+    end_ = next_ + batch_;
+}
+
+namespace detail {
+
 template <class C>
-detail::storage_type<C> &registry::storage_for()
+void *stage<C>::publish(registry &reg, handle_type owner, size_t index)
+{
+    return reg.construct_component(owner, std::move(items_[index]));
+}
+
+template <class C>
+void stage<C>::unpublish(registry &reg, void *comp) const
+{
+    reg.components_.at(type_hash<C>())->erase(comp);
+}
+
+template <class C>
+void stage<C>::check_journaled(const registry &reg) const
+{
+    reg.check_journaled<C>();
+}
+
+template <class C>
+void stage<C>::journal(registry &reg, const void *comp) const
+{
+    reg.journal_component(*static_cast<const C *>(comp));
+}
+
+} // namespace detail
+
+template <class C>
+detail::storage<std::remove_cvref_t<C>> &registry::typed_storage()
 {
+    using type = detail::storage<std::remove_cvref_t<C>>;
     const auto hash = detail::type_hash<C>();
 
-    if (!components_.contains(hash)) {
+    if (!components_.contains(hash))
         components_.emplace(hash,
-                std::make_unique<detail::storage_type<C>>());
-    }
+                detail::make_pmr<type>(resource_, resource_));
+
+    return static_cast<type &>(*components_.at(hash));
+}
 
-    return *reinterpret_cast<detail::storage_type<C> *>(
-            components_.at(hash).get());
+template <class C>
+detail::storage_type<C> &registry::storage_for()
+{
+    return typed_storage<C>().components();
 }
 
 template <class C, class... Cs>
 auto registry::range()
 {
-    if constexpr (sizeof...(Cs) == 0) {
-        return component_range<C>(storage_for<C>());
+    if constexpr (detail::is_buffered<C, Cs...>) {
+        return buffered_range_for<C, Cs...>();
+    } else if constexpr (sizeof...(Cs) == 0) {
+        using type = std::remove_cvref_t<C>;
+
+        // components owned by a group are not in the colony
+        std::span<type> grouped;
+        if (auto it = owned_.find(detail::type_hash<C>());
+            it != std::end(owned_))
+        {
+            const auto group = it->second;
+            grouped = std::span(static_cast<type *>(
+                    group->data(detail::type_hash<C>())),
+                    group->size());
+        }
+
+        if (frozen_ && !components_.contains(detail::type_hash<C>())) {
+            // no C can be created until the registry is thawed,
+            // and readers must not add a storage
+            return component_range<C>(grouped);
+        }
+
+        return component_range<C>(storage_for<C>(), grouped);
     } else {
         return range_for<C, Cs...>();
     }
 }
 
+template <class C, class... Cs, class F>
+void registry::each(F &&fn)
+{
+    static_assert(detail::pairwise_distinct<C, Cs...>);
+    ECS_TRACE_SCOPE("each");
+
+    if constexpr (sizeof...(Cs) == 0) {
+        for (auto &comp : range<C>())
+            fn(comp);
+    } else {
+        // drive the query by the type with the fewest
+        // components, then look the others up
+        const std::array sizes{ candidates(detail::type_hash<C>()),
+                candidates(detail::type_hash<Cs>())... };
+        const auto driver = std::distance(std::begin(sizes),
+                std::ranges::min_element(sizes));
+
+        if (sizes[driver] == 0)
+            return;
+
+        const auto visit = [this, &fn](handle_type ent)
+        {
+            const auto &comps = entities_.at(ent).components;
+            const std::array found{
+                comps.find({ detail::type_hash<C>(), 0 }),
+                comps.find({ detail::type_hash<Cs>(), 0 })... };
+
+            for (const auto it : found) {
+                if (it == std::end(comps))
+                    return;
+            }
+
+            [&]<size_t... Is>(std::index_sequence<Is...>)
+            {
+                fn(*static_cast<C *>(found[0]->ptr),
+                    *static_cast<Cs *>(found[Is + 1]->ptr)...);
+            }(std::index_sequence_for<Cs...>{});
+        };
+
+        [&]<size_t... Is>(std::index_sequence<Is...>)
+        {
+            using types = std::tuple<C, Cs...>;
+            (..., (static_cast<size_t>(driver) == Is
+                ? each_candidate<std::tuple_element_t<Is, types>>(visit)
+                : void()));
+        }(std::index_sequence_for<C, Cs...>{});
+    }
+}
+
+inline registry::size_type registry::candidates(
+    size_type hash) const noexcept
+{
+    size_type count = 0;
+
+    if (auto it = components_.find(hash); it != std::end(components_))
+        count += it->second->size();
+    if (auto it = owned_.find(hash); it != std::end(owned_))
+        count += it->second->size();
+
+    return count;
+}
+
+template <class C, class F>
+void registry::each_candidate(F &&fn)
+{
+    const auto hash = detail::type_hash<C>();
+
+    if (auto it = components_.find(hash); it != std::end(components_)) {
+        const auto &stor = static_cast<
+                const detail::storage<std::remove_cvref_t<C>> &>(
+                *it->second);
+        const auto &comps = stor.components();
+
+        for (auto pos = comps.begin(); pos != comps.end(); ++pos)
+            fn(stor.owner(pos.pos()));
+    }
+
+    if (auto it = owned_.find(hash); it != std::end(owned_)) {
+        for (const auto ent : it->second->entities())
+            fn(ent);
+    }
+}
+
+template <class... Cs, class F>
+bool registry::resume(range_cursor<Cs...> &cursor, F &&fn,
+    size_type max_entities, std::chrono::nanoseconds budget)
+{
+    ECS_TRACE_SCOPE("resume");
+
+    using clock = std::chrono::steady_clock;
+    const auto deadline = budget == std::chrono::nanoseconds::max()
+        ? clock::time_point::max() : clock::now() + budget;
+
+    if (cursor.next_ == cursor.pending_.size()) {
+        // new pass over the entities in the tuple right now
+        cursor.pending_.clear();
+        cursor.next_ = 0;
+
+        if constexpr (sizeof...(Cs) == 1) {
+            each_candidate<Cs...>([&cursor](handle_type ent)
+            {
+                cursor.pending_.push_back(ent);
+            });
+        } else {
+            range_for<Cs...>();
+            const auto &range = ranges_.at(detail::xor_type_hash<Cs...>());
+
+            const auto stride = range.types.size() + 1;
+            cursor.pending_.reserve(range.views.size() / stride);
+            for (auto row = 0uz; row < range.views.size(); row += stride) {
+                cursor.pending_.push_back(
+                        reinterpret_cast<handle_type>(range.views[row]));
+            }
+        }
+    }
+
+    for (size_type visited = 0; visited < max_entities
+        && cursor.next_ < cursor.pending_.size();)
+    {
+        const auto ent = cursor.pending_[cursor.next_++];
+
+        const auto it = entities_.find(ent);
+        if (it == std::end(entities_))
+            continue;
+
+        const auto &comps = it->second.components;
+        const std::array found{
+            comps.find({ detail::type_hash<Cs>(), 0 })... };
+        if (std::ranges::any_of(found, [&comps](auto pos)
+            {
+                return pos == std::end(comps);
+            }))
+        {
+            continue;
+        }
+
+        [&]<size_t... Is>(std::index_sequence<Is...>)
+        {
+            fn(*static_cast<Cs *>(found[Is]->ptr)...);
+        }(std::index_sequence_for<Cs...>{});
+
+        ++visited;
+        if (deadline != clock::time_point::max()
+            && clock::now() >= deadline)
+        {
+            break;
+        }
+    }
+
+    if (cursor.next_ < cursor.pending_.size())
+        return false;
+
+    ++cursor.passes_;
+    return true;
+}
+
 template <class... Cs>
 typed_view_range<Cs...> registry::range_for()
 {
     static_assert(detail::pairwise_distinct<Cs...>);
+    ECS_TRACE_SCOPE("range_for");
 
     const auto xor_hash = detail::xor_type_hash<Cs...>();
 
-    if (ranges_.contains(xor_hash)) {
-        return typed_view_range<Cs...>(ranges_.at(xor_hash));
+    if (auto it = ranges_.find(xor_hash); it != std::end(ranges_)) {
+        // frozen ranges are flushed and shared among readers
+        if (frozen_)
+            return typed_view_range<Cs...>(it->second);
+
+        it->second.usage.last_used = tick_;
+        ++it->second.usage.hits;
+        flush(it->second);
+        return typed_view_range<Cs...>(it->second);
     }
 
+    if (frozen_)
+        throw std::logic_error("range is not built, the registry is frozen");
+
     // construct the range
-    view_range range;
+    view_range range(resource_);
     range.types.reserve(sizeof...(Cs));
     (range.types.emplace(detail::type_hash<Cs>()), ...);
 
-    // NOTE: perf: instead of checking each
-    // individual entities' component hashes for a
-    // collision with the view's types, remember which
-    // component xor hashes fit and which don't so that
-    // the collision only has to be computed once for
-    // every unique set of components (entity type)
-    // TODO: perf: probably faster just using a vector
-    std::unordered_set<size_type> included;
-    std::unordered_set<size_type> excluded;
+    build(range);
+
+    range.usage = { tick_, 1 };
+    ranges_.emplace(xor_hash, std::move(range));
+    return typed_view_range<Cs...>(ranges_.at(xor_hash));
+}
 
-    std::array<void *, sizeof...(Cs)> view;
+template <class... Cs>
+buffered_range<Cs...> registry::buffered_range_for()
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
 
-    for (const auto &[ent, info] : entities_) {
-        if (excluded.contains(info.xor_hash)) {
-            continue;
-        }
+    // read_prev<C> and write_next<C> share the range over
+    // the stored double_buffered<C>
+    using stored = detail::unique_tuple_t<
+            typename detail::buffer_access<Cs>::component...>;
 
-        if (!included.contains(info.xor_hash)) {
-            if (!range.captures(info.components)) {
-                excluded.emplace(info.xor_hash);
-                continue;
+    [this]<class... Us>(std::type_identity<std::tuple<Us...>>)
+    {
+        range_for<Us...>();
+    }(std::type_identity<stored>{});
+
+    const auto xor_hash = []<class... Us>(
+        std::type_identity<std::tuple<Us...>>)
+    {
+        return detail::xor_type_hash<Us...>();
+    }(std::type_identity<stored>{});
+
+    return buffered_range<Cs...>(ranges_.at(xor_hash), tick_);
+}
+
+inline void registry::build(view_range &range) const
+{
+    ECS_TRACE_SCOPE("build range");
+
+    // split the buckets of the entity map among the workers,
+    // every worker fills its own rows, which are then joined
+    const auto buckets = entities_.bucket_count();
+    const auto workers = entities_.size() < parallel_build_min
+        ? 1uz
+        : std::min<size_type>(buckets,
+                std::max(1u, std::thread::hardware_concurrency()));
+
+    // the workers allocate from the default resource, as
+    // resource_ need not be thread safe
+    std::vector<std::pmr::vector<void *>> rows(workers > 1 ? workers : 0);
+
+    const auto fill = [&](size_type worker)
+    {
+        // NOTE: perf: instead of checking each
+        // individual entities' component hashes for a
+        // collision with the view's types, remember which
+        // component xor hashes fit and which don't so that
+        // the collision only has to be computed once for
+        // every unique set of components (entity type)
+        // TODO: perf: probably faster just using a vector
+        std::unordered_set<size_type> included;
+        std::unordered_set<size_type> excluded;
+
+        std::vector<void *> view(std::size(range));
+        auto &out = workers == 1 ? range.views : rows[worker];
+
+        const auto first = buckets * worker / workers;
+        const auto last = buckets * (worker + 1) / workers;
+
+        for (auto bucket = first; bucket < last; ++bucket) {
+            for (auto it = entities_.begin(bucket);
+                it != entities_.end(bucket); ++it)
+            {
+                const auto &[ent, info] = *it;
+
+                if (excluded.contains(info.xor_hash))
+                    continue;
+
+                if (!included.contains(info.xor_hash)) {
+                    if (!range.captures(info.components)) {
+                        excluded.emplace(info.xor_hash);
+                        continue;
+                    }
+                    included.emplace(info.xor_hash);
+                }
+
+                // create a new view
+                auto ptr = view.begin();
+                for (const auto hash : range.types)
+                    *ptr++ = info.components.find({ hash, 0 })->ptr;
+
+                view_range::push_back(out, ent, view);
             }
-            included.emplace(info.xor_hash);
         }
+    };
 
-        // create a new view
-        auto it = view.begin();
-        for (const auto hash : range.types) {
-            *it++ = info.components.find({ hash, 0 })->ptr;
+    std::vector<std::future<void>> pending;
+    for (auto worker = 1uz; worker < workers; ++worker)
+        pending.push_back(std::async(std::launch::async, fill, worker));
+
+    fill(0);
+
+    // rethrows exceptions of the workers
+    for (auto &worker : pending)
+        worker.get();
+
+    if (workers == 1)
+        return;
+
+    auto size = 0uz;
+    for (const auto &part : rows)
+        size += part.size();
+
+    range.views.reserve(size);
+    for (const auto &part : rows)
+        range.views.insert(range.views.end(), part.begin(), part.end());
+}
+
+inline void registry::flush(view_range &range)
+{
+    ECS_TRACE_SCOPE("flush range");
+
+    if (!range.pending_erase.empty()) {
+        range.erase(range.pending_erase);
+        range.pending_erase.clear();
+    }
+
+    if (range.pending_add.empty())
+        return;
+
+    // the components are looked up now, so moves in the
+    // meantime need not be tracked
+    row_.resize(std::size(range));
+
+    for (const auto ent : range.pending_add) {
+        const auto it = entities_.find(ent);
+        if (it == std::end(entities_)
+            || !range.captures(it->second.components))
+        {
+            continue;
         }
 
-        range.push_back(ent, std::span(
-                view.data(), std::size(range)));
-    };
+        auto ptr = row_.begin();
+        for (const auto hash : range.types)
+            *ptr++ = it->second.components.find({ hash, 0 })->ptr;
 
-    ranges_.emplace(xor_hash, std::move(range));
-    return typed_view_range<Cs...>(ranges_.at(xor_hash));
+        range.push_back(ent, std::span(row_.data(), std::size(range)));
+    }
+
+    range.pending_add.clear();
+}
+
+inline void registry::flush_ranges()
+{
+    for (auto &[xor_hash, range] : ranges_)
+        flush(range);
 }
 
 template <class C>
-std::tuple<registry::size_type, std::remove_cvref_t<C> *>
-registry::construct_component(handle_type owner, C &&arg)
+std::remove_cvref_t<C> *registry::construct_component(
+    handle_type owner, C &&arg)
 {
-    auto &stor = storage_for<C>();
-    size_type pos = stor.push_back(std::forward<C>(arg));
+    auto *comp = typed_storage<C>().insert(owner,
+            std::forward<C>(arg));
 
-    auto &comp = stor.at(pos);
     if constexpr (detail::FatComponent<C>) {
         // set owner
-        comp.owner = owner;
+        comp->owner = owner;
     } else {
     }
 
-    return std::make_tuple(pos, &(stor.at(pos)));
+    return comp;
 }
 
 template <class C>
@@ -312,43 +1002,266 @@ inline bool registry::contains(handle_type ent) const noexcept
 
 inline void registry::destroy(handle_type ent)
 {
+    check_thawed();
+
     if (!entities_.contains(ent))
         throw std::out_of_range("no such entity");
 
     // remove views
     const auto &info = entities_.at(ent);
     for (auto &[xor_hash, range] : ranges_) {
-        if (range.captures(info.components))
+        if (!range.captures(info.components))
+            continue;
+
+        if (deferred_)
+            range.pending_erase.insert(ent);
+        else
             range.erase(ent);
     }
 
-    // destoy components
-    info.dtor(*this, ent);
+    // destroy components, those owned by a group first,
+    // as the group moves another entity into their place
+    relocation_map moved(pool_.get());
+    for (auto &[xor_hash, group] : groups_) {
+        if (group->captures(info.components))
+            group->erase(info.components, relocate_member(moved));
+    }
+    relocate_views(moved);
+
+    for (const auto &[hash, ptr] : info.components) {
+        const auto owner = owned_.find(hash);
+        if (owner != std::end(owned_)
+            && owner->second->captures(info.components))
+        {
+            continue;
+        }
+
+        components_.at(hash)->erase(ptr);
+    }
 
     entities_.erase(ent);
+
+    if (journal_ != nullptr)
+        journal_write(journal::op::destroy, std::uint64_t(ent));
 }
 
-template <class C>
-C &registry::emplace(handle_type ent, C &&arg)
+template <class C, class... Cs, class F>
+registry::size_type registry::destroy_if(F &&pred)
 {
-    if (!entities_.contains(ent))
-        throw std::out_of_range("no such entity");
+    static_assert(detail::pairwise_distinct<C, Cs...>);
 
-    const auto hash = detail::type_hash<C>();
-    auto &info = entities_.at(ent);
+    check_thawed();
+
+    handle_set victims(pool_.get());
+
+    if constexpr (sizeof...(Cs) == 0) {
+        const auto hash = detail::type_hash<C>();
+
+        if (auto it = components_.find(hash); it != std::end(components_)) {
+            auto &stor = static_cast<
+                    detail::storage<std::remove_cvref_t<C>> &>(*it->second);
+            auto &comps = stor.components();
+
+            for (auto pos = comps.begin(); pos != comps.end(); ++pos) {
+                if (pred(*pos))
+                    victims.insert(stor.owner(pos.pos()));
+            }
+        }
+
+        if (auto it = owned_.find(hash); it != std::end(owned_)) {
+            const auto &ents = it->second->entities();
+            auto *comps = static_cast<std::remove_cvref_t<C> *>(
+                    it->second->data(hash));
+
+            for (auto i = 0uz; i < ents.size(); ++i) {
+                if (pred(comps[i]))
+                    victims.insert(ents[i]);
+            }
+        }
+    } else {
+        auto range = range_for<C, Cs...>();
+
+        for (auto it = range.begin(); it != range.end(); ++it) {
+            auto &row = *it;
+            const bool match = [&]<size_t... Is>(std::index_sequence<Is...>)
+            {
+                return pred(row.template get<Is>()...);
+            }(std::index_sequence_for<C, Cs...>{});
+
+            if (match)
+                victims.insert(reinterpret_cast<handle_type>(*it.pos()));
+        }
+    }
+
+    destroy_all(victims);
+    return victims.size();
+}
+
+inline void registry::destroy_all(const handle_set &ents)
+{
+    if (ents.empty())
+        return;
+
+    // one pass per range, instead of a search per entity
+    for (auto &[xor_hash, range] : ranges_)
+        range.erase(ents);
+
+    // group members take the place of the destroyed ones and
+    // may be moved several times, only their first and last
+    // address matter to the rows, which are patched once
+    relocation_map moved(pool_.get());
+    relocation_map origin(pool_.get());
+    const auto relocate = [&](handle_type owner, void *from, void *to)
+    {
+        for (const auto &comp : entities_.at(owner).components) {
+            if (comp.ptr == from)
+                comp.ptr = to;
+        }
+
+        void *first = from;
+        if (auto it = origin.find(from); it != std::end(origin)) {
+            first = it->second;
+            origin.erase(it);
+        }
+        moved[first] = to;
+        origin[to] = first;
+    };
+
+    for (auto &[xor_hash, group] : groups_) {
+        for (const auto ent : ents) {
+            const auto &comps = entities_.at(ent).components;
+            if (group->captures(comps))
+                group->erase(comps, relocate);
+        }
+    }
+    relocate_views(moved);
+
+    // collect the remaining components by type, to erase
+    // them from their colonies in one batch
+    std::pmr::unordered_map<size_type,
+            std::pmr::vector<void *>> garbage(pool_.get());
+
+    for (const auto ent : ents) {
+        const auto &comps = entities_.at(ent).components;
+
+        for (const auto &[hash, ptr] : comps) {
+            const auto owner = owned_.find(hash);
+            if (owner != std::end(owned_)
+                && owner->second->captures(comps))
+            {
+                continue;
+            }
+
+            garbage[hash].push_back(ptr);
+        }
+    }
+
+    for (const auto &[hash, ptrs] : garbage)
+        components_.at(hash)->erase(ptrs);
+
+    for (const auto ent : ents) {
+        entities_.erase(ent);
+
+        if (journal_ != nullptr)
+            journal_write(journal::op::destroy, std::uint64_t(ent));
+    }
+}
+
+inline void registry::clear()
+{
+    check_thawed();
+
+    // keep the ranges and groups, only empty them
+    for (auto &[xor_hash, range] : ranges_)
+        range.clear();
+
+    for (auto &[xor_hash, group] : groups_)
+        group->clear();
+
+    for (auto &[hash, stor] : components_)
+        stor->clear();
+
+    entities_.clear();
+
+    if (journal_ != nullptr)
+        journal_write(journal::op::clear);
+}
+
+template <class C>
+void registry::clear()
+{
+    check_thawed();
+
+    const auto hash = detail::type_hash<C>();
+
+    if (journal_ != nullptr)
+        journal_write(journal::op::clear_type,
+                persistent_id<std::remove_cvref_t<C>>);
+
+    // no entity can stay in the group that owns C, move
+    // their other components out of it. Back to front, so
+    // no member is moved within the group
+    relocation_map moved(pool_.get());
+    if (auto it = owned_.find(hash); it != std::end(owned_)) {
+        auto &group = *it->second;
+        while (group.size() > 0)
+            leave(group, group.entities().back(), moved);
+    }
+    relocate_views(moved);
+
+    // every row of these ranges includes a C
+    for (auto &[xor_hash, range] : ranges_) {
+        if (range.types.contains(hash))
+            range.clear();
+    }
+
+    auto it = components_.find(hash);
+    if (it == std::end(components_))
+        return;
+
+    auto &stor = static_cast<detail::storage<std::remove_cvref_t<C>> &>(
+            *it->second);
+    const auto &comps = stor.components();
+
+    for (auto pos = comps.begin(); pos != comps.end(); ++pos) {
+        auto &info = entities_.at(stor.owner(pos.pos()));
+        info.components.erase({ hash, 0 });
+        info.xor_hash ^= hash;
+    }
+
+    stor.clear();
+}
+
+template <class C>
+C &registry::emplace(handle_type ent, C &&arg)
+{
+    check_thawed();
+
+    if (!entities_.contains(ent))
+        throw std::out_of_range("no such entity");
+
+    const auto hash = detail::type_hash<C>();
+    auto &info = entities_.at(ent);
     auto &comps = info.components;
     if (comps.contains({ hash, 0 }))
         throw std::logic_error("duplicate component");
+    check_journaled<C>();
 
-    auto [pos, ptr] = construct_component(ent,
+    auto ptr = construct_component(ent,
             std::forward<C>(arg));
 
     comps.emplace(hash, ptr);
     info.xor_hash ^= hash;
-    info.dtor = nested_entity_dtor<C>(std::move(info.dtor));
+
+    if (!groups_.empty()) {
+        // moves the views' components too
+        relocation_map moved(pool_.get());
+        adopt(ent, comps, moved);
+        relocate_views(moved);
+    }
 
     // update view
-    std::vector<void *> view(comps.size() + 1uz);
+    row_.resize(comps.size());
 
     for (auto &[xor_hash, range] : ranges_) {
         if (!range.types.contains(hash))
@@ -358,70 +1271,81 @@ C &registry::emplace(handle_type ent, C &&arg)
         if (!range.captures(comps))
             continue;
 
+        if (deferred_) {
+            range.pending_add.push_back(ent);
+            continue;
+        }
+
         // create a new view
-        auto it = view.data();
+        auto it = row_.data();
         for (const auto hash : range.types) {
             *it++ = comps.find({ hash, 0 })->ptr;
         }
 
         range.push_back(ent, std::span(
-            view.data(), view.capacity()));
+            row_.data(), std::size(range)));
     }
 
-    return *ptr;
-}
-
-template <class C, class... Args>
-C &registry::emplace(handle_type ent, Args &&...args)
-{
-    // extra move but less code
-    return emplace(ent, C(std::forward<Args>(args)...));
-}
+    auto &comp = *static_cast<std::remove_cvref_t<C> *>(
+            comps.find({ hash, 0 })->ptr);
 
-inline registry::entity_dtor_fn registry::placeholder_dtor()
-{
-    // for componentless entities
-    return [](registry &, handle_type) { };
-}
-
-template <class... Cs>
-registry::entity_dtor_fn registry::entity_dtor()
-{
-    // destroys all components Cs
-    return [](registry &reg, handle_type ent)
-    {
-        (..., reg.destroy_component<Cs>(ent));
-    };
-}
+    if (journal_ != nullptr) {
+        journal_write(journal::op::emplace, std::uint64_t(ent));
+        journal_component(comp);
+    }
 
-template <class... Cs>
-registry::entity_dtor_fn registry::nested_entity_dtor(
-    entity_dtor_fn &&previous_dtor)
-{
-    // if components are added after creation with
-    // emplace(), they cant't be destoyed by the
-    // original dtor.  So we create a new dtor to
-    // destroy the emplace'd component, and then
-    // call the previous dtor to destroy the rest.
-    return [previous_dtor](registry &reg, handle_type ent)
-    {
-        previous_dtor(reg, ent);
-        (..., reg.destroy_component<Cs>(ent));
-    };
+    return comp;
 }
 
 template <class C>
-void registry::destroy_component(handle_type ent)
+void registry::remove(handle_type ent)
 {
-    using type = std::remove_cvref_t<C>;
+    check_thawed();
 
-    const auto &comps = entities_.at(ent).components;
+    if (!entities_.contains(ent))
+        throw std::out_of_range("no such entity");
 
-    auto it = comps.find({ detail::type_hash<type>(), 0 });
-    if (it == std::end(comps))
+    const auto hash = detail::type_hash<C>();
+    auto &info = entities_.at(ent);
+    auto &comps = info.components;
+    if (!comps.contains({ hash, 0 }))
         throw std::invalid_argument("no such component");
 
-    storage_for<type>().erase(static_cast<type *>(it->ptr));
+    for (auto &[xor_hash, range] : ranges_) {
+        if (!range.types.contains(hash) || !range.captures(comps))
+            continue;
+
+        if (deferred_)
+            range.pending_erase.insert(ent);
+        else
+            range.erase(ent);
+    }
+
+    // without C, the entity no longer belongs to its group
+    if (auto owner = owned_.find(hash); owner != std::end(owned_)
+        && owner->second->captures(comps))
+    {
+        relocation_map moved(pool_.get());
+        leave(*owner->second, ent, moved);
+        relocate_views(moved);
+    }
+
+    const auto it = comps.find({ hash, 0 });
+    components_.at(hash)->erase(it->ptr);
+    comps.erase(it);
+    info.xor_hash ^= hash;
+
+    if (journal_ != nullptr) {
+        journal_write(journal::op::remove, std::uint64_t(ent),
+                persistent_id<std::remove_cvref_t<C>>);
+    }
+}
+
+template <class C, class... Args>
+C &registry::emplace(handle_type ent, Args &&...args)
+{
+    // extra move but less code
+    return emplace(ent, C(std::forward<Args>(args)...));
 }
 
 template <class S>
@@ -431,12 +1355,14 @@ S &registry::singleton()
     if (!singletons_.contains(hash))
         throw std::out_of_range("no such singleton");
 
-    return *static_cast<S *>(singletons_.at(hash).get());
+    return *static_cast<S *>(singletons_.at(hash).value.get());
 }
 
 template <class S>
 S &registry::singleton(S &&arg)
 {
+    check_thawed();
+
     const auto hash = detail::type_hash<S>();
     if (singletons_.contains(hash)) {
         // throw, duplicate emplace has no effect
@@ -444,14 +1370,16 @@ S &registry::singleton(S &&arg)
     }
 
     singletons_.emplace(hash,
-            std::make_unique<S>(std::forward<S>(arg)));
+            make_singleton<S>(resource_, std::forward<S>(arg)));
 
-    return *static_cast<S *>(singletons_.at(hash).get());
+    return *static_cast<S *>(singletons_.at(hash).value.get());
 }
 
 template <class S, class... Args>
 S &registry::singleton(std::in_place_t, Args &&...args)
 {
+    check_thawed();
+
     const auto hash = detail::type_hash<S>();
     if (singletons_.contains(hash)) {
         // throw, duplicate emplace has no effect
@@ -459,9 +1387,30 @@ S &registry::singleton(std::in_place_t, Args &&...args)
     }
 
     singletons_.emplace(hash,
-            std::make_unique<S>(std::forward<Args>(args)...));
+            make_singleton<S>(resource_, std::forward<Args>(args)...));
+
+    return *static_cast<S *>(singletons_.at(hash).value.get());
+}
+
+template <class S>
+registry::singleton_entry registry::make_singleton(
+    std::pmr::memory_resource *resource, auto &&...args)
+{
+    singleton_entry entry{ std::allocate_shared<S>(
+            std::pmr::polymorphic_allocator<S>(resource),
+            std::forward<decltype(args)>(args)...), nullptr };
+
+    if constexpr (std::is_copy_constructible_v<S>) {
+        entry.copy = [](const void *value,
+            std::pmr::memory_resource *resource)
+        {
+            return std::static_pointer_cast<void>(std::allocate_shared<S>(
+                    std::pmr::polymorphic_allocator<S>(resource),
+                    *static_cast<const S *>(value)));
+        };
+    }
 
-    return *static_cast<S *>(singletons_.at(hash).get());
+    return entry;
 }
 
 template <detail::FatComponent C>
@@ -477,7 +1426,7 @@ bool registry::has_sibling(const F &comp) const
     if (!entities_.contains(ent))
         throw std::out_of_range("no such entity");
 
-    const auto &[xor_hash, comps, dtor] = entities_.at(ent);
+    const auto &[xor_hash, comps] = entities_.at(ent);
     return comps.contains({ detail::type_hash<C>(), 0 });
 }
 
@@ -487,37 +1436,1211 @@ C &registry::sibling(const F &comp)
     return get<C>(entity_of(comp));
 }
 
-template <class C>
-component_range<C>::component_range(
-    detail::storage_type<C> &components)
-    : components_(components)
+inline void registry::optimize()
+{
+    check_thawed();
+
+    relocation_map moved(pool_.get());
+    const auto record = [&moved](void *from, void *to)
+    {
+        moved.emplace(from, to);
+    };
+
+    flush_ranges();
+
+    for (auto &[hash, stor] : components_)
+        stor->compact(record);
+
+    relocate(moved);
+
+    for (auto &[xor_hash, range] : ranges_)
+        range.sort();
+}
+
+template <class C, class... Cs>
+bool registry::release_range()
+{
+    static_assert(sizeof...(Cs) > 0,
+            "ranges of a single type are not cached");
+
+    check_thawed();
+
+    return ranges_.erase(detail::xor_type_hash<C, Cs...>()) > 0;
+}
+
+template <class C, class... Cs>
+std::optional<range_usage> registry::usage() const
+{
+    static_assert(sizeof...(Cs) > 0,
+            "ranges of a single type are not cached");
+
+    auto it = ranges_.find(detail::xor_type_hash<C, Cs...>());
+    if (it == std::end(ranges_))
+        return std::nullopt;
+
+    return it->second.usage;
+}
+
+inline void registry::evict_ranges_after(size_type ticks) noexcept
+{
+    evict_after_ = ticks;
+}
+
+template <class... Tuples>
+void registry::prebuild()
+{
+    check_thawed();
+
+    const auto build_range = [this]<class... Cs>(std::type_identity<
+            std::tuple<Cs...>>)
+    {
+        range_for<Cs...>();
+    };
+
+    (..., build_range(std::type_identity<Tuples>{}));
+}
+
+template <class... Cs>
+void registry::save(std::ostream &out) const
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be saved");
+
+    const auto write = [&out](const void *src, size_t bytes)
+    {
+        out.write(static_cast<const char *>(src), bytes);
+    };
+    const auto write_value = [&write](std::uint64_t value)
+    {
+        write(&value, sizeof(value));
+    };
+
+    write(&snapshot_magic, sizeof(snapshot_magic));
+    write(&snapshot_version, sizeof(snapshot_version));
+    write_value(sizeof...(Cs));
+    write_value(max_entity_handle_.load());
+
+    // entities without components must survive as well
+    std::vector<handle_type> handles;
+    handles.reserve(entities_.size());
+    for (const auto &[ent, info] : entities_)
+        handles.push_back(ent);
+
+    write_value(handles.size());
+    write(handles.data(), handles.size() * sizeof(handle_type));
+
+    const auto save_type = [&]<class C>(std::type_identity<C>)
+    {
+        const auto hash = detail::type_hash<C>();
+        write_value(persistent_id<C>);
+        write_value(sizeof(C));
+
+        if (auto it = components_.find(hash); it != std::end(components_)) {
+            static_cast<const detail::storage<C> &>(*it->second)
+                .save(write);
+        } else {
+            detail::storage<C>(std::pmr::get_default_resource())
+                .save(write);
+        }
+
+        // grouped components are copied from the group arrays
+        auto group = owned_.find(hash);
+        const auto size = group != std::end(owned_)
+            ? group->second->size() : 0uz;
+
+        write_value(size);
+        if (size > 0) {
+            write(group->second->entities().data(),
+                    size * sizeof(handle_type));
+            write(group->second->data(hash), size * sizeof(C));
+        }
+    };
+
+    (..., save_type(std::type_identity<std::remove_cvref_t<Cs>>{}));
+
+    if (!out)
+        throw std::runtime_error("failed to write snapshot");
+}
+
+template <class... Cs>
+void registry::load(std::istream &in)
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be loaded");
+
+    check_thawed();
+
+    if (journal_ != nullptr)
+        throw std::logic_error("cannot load a journaled registry");
+
+    detail::stream_reader read(in, "truncated snapshot");
+    const auto read_value = [&read]
+    {
+        std::uint64_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    };
+
+    std::uint32_t magic = 0;
+    std::uint32_t version = 0;
+    read(&magic, sizeof(magic));
+    read(&version, sizeof(version));
+    if (magic != snapshot_magic || version != snapshot_version)
+        throw std::invalid_argument("not a snapshot");
+    if (read_value() != sizeof...(Cs))
+        throw std::invalid_argument("snapshot component types differ");
+
+    // ranges are built again when they are requested
+    clear();
+    ranges_.clear();
+
+    max_entity_handle_.store(read_value());
+
+    std::vector<handle_type> handles(
+            read.count(read_value(), sizeof(handle_type)));
+    read(handles.data(), handles.size() * sizeof(handle_type));
+    entities_.reserve(handles.size());
+    for (const auto ent : handles)
+        entities_.emplace(ent, entinfo(0, component_set(pool_.get())));
+
+    const auto load_type = [&]<class C>(std::type_identity<C>)
+    {
+        const auto hash = detail::type_hash<C>();
+        if (read_value() != persistent_id<C> || read_value() != sizeof(C))
+            throw std::invalid_argument("snapshot component types differ");
+
+        const auto attach = [&](handle_type ent, void *ptr)
+        {
+            auto &info = entities_.at(ent);
+            info.components.emplace(hash, ptr);
+            info.xor_hash ^= hash;
+        };
+
+        auto &stor = typed_storage<C>();
+        stor.load(read);
+
+        auto &comps = stor.components();
+        for (auto pos = comps.begin(); pos != comps.end(); ++pos)
+            attach(stor.owner(pos.pos()), &*pos);
+
+        // back into the colony, groups adopt them below
+        std::vector<handle_type> owners(
+                read.count(read_value(), sizeof(handle_type) + sizeof(C)));
+        std::vector<C> grouped(owners.size());
+        read(owners.data(), owners.size() * sizeof(handle_type));
+        read(grouped.data(), grouped.size() * sizeof(C));
+
+        for (auto i = 0uz; i < owners.size(); ++i)
+            attach(owners[i], stor.insert(owners[i], grouped[i]));
+    };
+
+    (..., load_type(std::type_identity<std::remove_cvref_t<Cs>>{}));
+
+    if (!groups_.empty()) {
+        relocation_map moved(pool_.get());
+        for (const auto &[ent, info] : entities_)
+            adopt(ent, info.components, moved);
+    }
+}
+
+template <class... Cs>
+void registry::encode_delta(const registry &baseline,
+    std::ostream &out) const
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be diffed");
+
+    // the whole delta is encoded first and written at once
+    std::vector<std::byte> buf;
+    const auto put = [&buf](const void *src, size_t bytes)
+    {
+        const auto first = static_cast<const std::byte *>(src);
+        buf.insert(buf.end(), first, first + bytes);
+    };
+    const auto put_value = [&buf](std::uint64_t value)
+    {
+        detail::write_varint(buf, value);
+    };
+    const auto put_list = [&](const std::vector<handle_type> &ents)
+    {
+        put_value(ents.size());
+        for (const auto ent : ents)
+            put_value(ent);
+    };
+    const auto find = [](const registry &reg, handle_type ent,
+        size_type hash) -> const void *
+    {
+        const auto it = reg.entities_.find(ent);
+        if (it == std::end(reg.entities_))
+            return nullptr;
+
+        const auto comp = it->second.components.find({ hash, 0 });
+        if (comp == std::end(it->second.components))
+            return nullptr;
+
+        return comp->ptr;
+    };
+
+    put(&delta_magic, sizeof(delta_magic));
+    put(&delta_version, sizeof(delta_version));
+    put_value(sizeof...(Cs));
+    put_value(max_entity_handle_.load());
+
+    std::vector<handle_type> ents;
+    for (const auto &[ent, info] : baseline.entities_) {
+        if (!entities_.contains(ent))
+            ents.push_back(ent);
+    }
+    put_list(ents);
+
+    ents.clear();
+    for (const auto &[ent, info] : entities_) {
+        if (!baseline.entities_.contains(ent))
+            ents.push_back(ent);
+    }
+    put_list(ents);
+
+    const auto encode_type = [&]<class C>(std::type_identity<C>)
+    {
+        const auto hash = detail::type_hash<C>();
+        put_value(persistent_id<C>);
+        put_value(sizeof(C));
+
+        // removed from entities that still exist
+        ents.clear();
+        for (const auto &[ent, info] : baseline.entities_) {
+            if (entities_.contains(ent) && find(baseline, ent, hash)
+                && !find(*this, ent, hash))
+            {
+                ents.push_back(ent);
+            }
+        }
+        put_list(ents);
+
+        std::vector<std::pair<handle_type, const void *>> added;
+        std::vector<std::pair<handle_type, const void *>> changed;
+        for (const auto &[ent, info] : entities_) {
+            const auto cur = find(*this, ent, hash);
+            if (!cur)
+                continue;
+
+            const auto base = find(baseline, ent, hash);
+            if (!base)
+                added.emplace_back(ent, cur);
+            else if (std::memcmp(base, cur, sizeof(C)) != 0)
+                changed.emplace_back(ent, cur);
+        }
+
+        put_value(added.size());
+        for (const auto &[ent, cur] : added) {
+            put_value(ent);
+            put(cur, sizeof(C));
+        }
+
+        put_value(changed.size());
+        for (const auto &[ent, cur] : changed) {
+            put_value(ent);
+            detail::xor_rle_encode(buf,
+                    static_cast<const std::byte *>(find(baseline, ent, hash)),
+                    static_cast<const std::byte *>(cur), sizeof(C));
+        }
+    };
+
+    (..., encode_type(std::type_identity<std::remove_cvref_t<Cs>>{}));
+
+    out.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+    if (!out)
+        throw std::runtime_error("failed to write delta");
+}
+
+template <class... Cs>
+void registry::apply_delta(std::istream &in)
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be diffed");
+
+    check_thawed();
+
+    if (journal_ != nullptr)
+        throw std::logic_error("cannot apply a delta to a journaled registry");
+
+    detail::stream_reader read(in, "truncated delta");
+    const auto read_value = [&read]
+    {
+        return detail::read_varint(read);
+    };
+    const auto mismatch = []
+    {
+        return std::invalid_argument("delta does not match the registry");
+    };
+
+    std::uint32_t magic = 0;
+    std::uint32_t version = 0;
+    read(&magic, sizeof(magic));
+    read(&version, sizeof(version));
+    if (magic != delta_magic || version != delta_version)
+        throw std::invalid_argument("not a delta");
+    if (read_value() != sizeof...(Cs))
+        throw std::invalid_argument("delta component types differ");
+
+    // the whole delta is read and checked first, so a
+    // truncated or mismatching one leaves the registry as it is
+    const auto next = read_value();
+
+    // counts are followed by at least one byte per element
+    std::vector<handle_type> destroyed(read.count(read_value(), 1));
+    std::unordered_set<handle_type> gone;
+    for (auto &ent : destroyed) {
+        ent = read_value();
+        if (!entities_.contains(ent) || !gone.insert(ent).second)
+            throw mismatch();
+    }
+
+    std::vector<handle_type> created(read.count(read_value(), 1));
+    std::unordered_set<handle_type> born;
+    for (auto &ent : created) {
+        ent = read_value();
+        if (entities_.contains(ent) || !born.insert(ent).second)
+            throw mismatch();
+    }
+
+    // whether ent exists and owns the type hash before and
+    // after the delta
+    const auto exists = [&](handle_type ent)
+    {
+        return born.contains(ent)
+            || (entities_.contains(ent) && !gone.contains(ent));
+    };
+    const auto owns = [this](handle_type ent, size_type hash)
+    {
+        const auto it = entities_.find(ent);
+        return it != std::end(entities_)
+            && it->second.components.contains({ hash, 0 });
+    };
+
+    // the new values of added and changed components
+    struct type_delta {
+        std::vector<handle_type> removed;
+        std::vector<std::pair<handle_type, size_t>> added;
+        std::vector<std::pair<handle_type, size_t>> changed;
+    };
+    std::array<type_delta, sizeof...(Cs)> deltas;
+    std::vector<std::byte> values;
+
+    const auto read_type = [&]<class C>(std::type_identity<C>,
+        type_delta &delta)
+    {
+        if (read_value() != persistent_id<C> || read_value() != sizeof(C))
+            throw std::invalid_argument("delta component types differ");
+
+        // an entity is listed once per type at most
+        const auto hash = detail::type_hash<C>();
+        std::unordered_set<handle_type> listed;
+
+        delta.removed.resize(read.count(read_value(), 1));
+        for (auto &ent : delta.removed) {
+            ent = read_value();
+            if (!exists(ent) || !owns(ent, hash)
+                || !listed.insert(ent).second)
+            {
+                throw mismatch();
+            }
+        }
+
+        delta.added.resize(read.count(read_value(), 1 + sizeof(C)));
+        for (auto &[ent, offset] : delta.added) {
+            ent = read_value();
+            if (!exists(ent) || owns(ent, hash)
+                || !listed.insert(ent).second)
+            {
+                throw mismatch();
+            }
+
+            offset = values.size();
+            values.resize(offset + sizeof(C));
+            read(values.data() + offset, sizeof(C));
+        }
+
+        // a handle and at least one run of two varints each
+        delta.changed.resize(read.count(read_value(), 3));
+        for (auto &[ent, offset] : delta.changed) {
+            ent = read_value();
+            if (!exists(ent) || !owns(ent, hash)
+                || !listed.insert(ent).second)
+            {
+                throw mismatch();
+            }
+
+            offset = values.size();
+            values.resize(offset + sizeof(C));
+            const auto comp = entities_.at(ent).components.find({ hash, 0 });
+            std::memcpy(values.data() + offset, comp->ptr, sizeof(C));
+            detail::xor_rle_apply(values.data() + offset, sizeof(C), read);
+        }
+    };
+
+    [&]<size_t... Is>(std::index_sequence<Is...>)
+    {
+        (..., read_type(std::type_identity<std::remove_cvref_t<Cs>>{},
+                deltas[Is]));
+    }(std::index_sequence_for<Cs...>{});
+
+    for (const auto ent : destroyed)
+        destroy(ent);
+
+    for (const auto ent : created)
+        entities_.emplace(ent, entinfo(0, component_set(pool_.get())));
+    max_entity_handle_.raise(next);
+
+    const auto apply_type = [&]<class C>(std::type_identity<C>,
+        const type_delta &delta)
+    {
+        for (const auto ent : delta.removed)
+            remove<C>(ent);
+
+        // copying the bytes creates the trivially copyable C
+        for (const auto &[ent, offset] : delta.added) {
+            alignas(C) std::byte value[sizeof(C)];
+            std::memcpy(value, values.data() + offset, sizeof(C));
+            emplace(ent, std::move(*std::launder(
+                    reinterpret_cast<C *>(value))));
+        }
+
+        for (const auto &[ent, offset] : delta.changed) {
+            std::memcpy(static_cast<void *>(&get<C>(ent)),
+                    values.data() + offset, sizeof(C));
+        }
+    };
+
+    [&]<size_t... Is>(std::index_sequence<Is...>)
+    {
+        (..., apply_type(std::type_identity<std::remove_cvref_t<Cs>>{},
+                deltas[Is]));
+    }(std::index_sequence_for<Cs...>{});
+}
+
+inline registry registry::clone() const
+{
+    registry copy(resource_);
+    copy.max_entity_handle_.store(max_entity_handle_.load());
+    copy.tick_ = tick_;
+    copy.evict_after_ = evict_after_;
+    copy.deferred_ = deferred_;
+
+    for (const auto &[hash, entry] : singletons_) {
+        if (entry.copy == nullptr)
+            throw std::logic_error("singleton is not copyable");
+        copy.singletons_.emplace(hash, singleton_entry{
+                entry.copy(entry.value.get(), resource_), entry.copy });
+    }
+
+    // the copies keep every component at the same position,
+    // so pointers are translated instead of looked up again
+    std::pmr::unordered_map<size_type,
+        detail::basic_storage::translate_fn> translators(resource_);
+    for (const auto &[hash, stor] : components_) {
+        auto &target = *copy.components_.emplace(hash,
+                stor->clone(resource_)).first->second;
+        translators.emplace(hash, stor->translator(target));
+    }
+
+    for (const auto &[xor_hash, group] : groups_) {
+        auto &target = *copy.groups_.emplace(xor_hash,
+                group->clone(resource_)).first->second;
+        for (const auto hash : group->types())
+            copy.owned_.emplace(hash, &target);
+    }
+
+    const auto translate = [&](size_type hash, void *ptr)
+    {
+        if (const auto it = owned_.find(hash); it != owned_.end()) {
+            if (const auto moved = it->second->translate(
+                    *copy.owned_.at(hash), hash, ptr))
+            {
+                return moved;
+            }
+        }
+        return translators.at(hash)(ptr);
+    };
+
+    copy.entities_.reserve(entities_.size());
+    for (const auto &[ent, info] : entities_) {
+        auto comps = component_set(copy.pool_.get());
+        comps.reserve(info.components.size());
+        for (const auto &comp : info.components)
+            comps.emplace(comp.hash, translate(comp.hash, comp.ptr));
+
+        copy.entities_.emplace(ent, entinfo(info.xor_hash,
+                    std::move(comps)));
+    }
+
+    for (const auto &[xor_hash, range] : ranges_) {
+        auto &target = copy.ranges_.emplace(xor_hash,
+                view_range(resource_)).first->second;
+        target.types.insert(range.types.begin(), range.types.end());
+        target.usage = range.usage;
+        target.pending_add.assign(range.pending_add.begin(),
+                range.pending_add.end());
+        target.pending_erase.insert(range.pending_erase.begin(),
+                range.pending_erase.end());
+
+        // rows hold the pointers in reverse iteration order
+        // of types, which may differ between the two sets
+        const auto column = [](const auto &types, size_type hash)
+        {
+            return static_cast<size_type>(std::distance(
+                    types.find(hash), types.end()) - 1);
+        };
+
+        const auto stride = range.types.size() + 1;
+        std::vector<std::pair<size_type, size_type>> columns(
+                range.types.size());
+        for (const auto hash : range.types) {
+            columns[column(range.types, hash)]
+                = { hash, column(target.types, hash) };
+        }
+
+        target.views.resize(range.views.size());
+        for (auto row = 0uz; row < range.views.size(); row += stride) {
+            target.views[row] = range.views[row];
+            for (auto i = 0uz; i < columns.size(); ++i) {
+                const auto [hash, to] = columns[i];
+                target.views[row + 1 + to] = translate(hash,
+                        range.views[row + 1 + i]);
+            }
+        }
+    }
+
+    return copy;
+}
+
+template <class... Cs>
+void registry::bake(std::ostream &out) const
+{
+    static_assert(sizeof...(Cs) > 0);
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be baked");
+    static_assert(((alignof(Cs) <= baked_segment::alignment) && ...));
+
+    using header = baked_segment::header;
+    using type_entry = baked_segment::type_entry;
+
+    // the entities with all Cs, by handle for lookups
+    std::vector<std::pair<handle_type, const component_set *>> baked;
+    for (const auto &[ent, info] : entities_) {
+        if ((info.components.contains({ detail::type_hash<Cs>(), 0 })
+            && ...))
+        {
+            baked.emplace_back(ent, &info.components);
+        }
+    }
+    std::ranges::sort(baked, std::less<>{},
+            &std::pair<handle_type, const component_set *>::first);
+
+    const auto align = [](size_type offset)
+    {
+        const auto alignment = baked_segment::alignment;
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+
+    header head{ baked_segment::magic, baked_segment::version,
+        baked.size(), sizeof...(Cs), 0 };
+    head.handles = align(sizeof(header) + sizeof...(Cs) * sizeof(type_entry));
+
+    std::array<type_entry, sizeof...(Cs)> types{ type_entry{
+            persistent_id<std::remove_cvref_t<Cs>>, sizeof(Cs), 0 }... };
+    auto offset = align(head.handles + baked.size() * sizeof(handle_type));
+    for (auto &type : types) {
+        type.offset = offset;
+        offset = align(offset + baked.size() * type.size);
+    }
+
+    size_type written = 0;
+    const auto write = [&](const void *src, size_t bytes)
+    {
+        out.write(static_cast<const char *>(src), bytes);
+        written += bytes;
+    };
+    const auto pad = [&]
+    {
+        static constexpr std::array<char, baked_segment::alignment> zeros{};
+        write(zeros.data(), align(written) - written);
+    };
+
+    write(&head, sizeof(head));
+    write(types.data(), sizeof(types));
+    pad();
+
+    for (const auto &[ent, comps] : baked)
+        write(&ent, sizeof(ent));
+    pad();
+
+    const auto bake_type = [&]<class C>(std::type_identity<C>)
+    {
+        for (const auto &[ent, comps] : baked)
+            write(comps->find({ detail::type_hash<C>(), 0 })->ptr, sizeof(C));
+        pad();
+    };
+
+    (..., bake_type(std::type_identity<std::remove_cvref_t<Cs>>{}));
+
+    if (!out)
+        throw std::runtime_error("failed to write baked segment");
+}
+
+inline void registry::attach(const baked_segment &segment)
+{
+    check_thawed();
+
+    const auto ents = segment.entities();
+    if (ents.empty())
+        return;
+
+    for (const auto ent : ents) {
+        if (entities_.contains(ent))
+            throw std::logic_error("baked entity exists");
+    }
+
+    max_entity_handle_.raise(ents.back() + 1);
+}
+
+inline void registry::set_journal(journal *journal) noexcept
+{
+    journal_ = journal;
+}
+
+template <class C>
+void registry::mark_written(handle_type ent)
+{
+    check_thawed();
+
+    auto &comp = get<C>(ent);
+
+    if (journal_ != nullptr) {
+        check_journaled<C>();
+        journal_write(journal::op::write, std::uint64_t(ent));
+        journal_component(comp);
+    }
+}
+
+template <class... Cs>
+void registry::check_journaled() const
+{
+    if (journal_ != nullptr
+        && !(std::is_trivially_copyable_v<std::remove_cvref_t<Cs>> && ...))
+    {
+        throw std::logic_error(
+                "only trivially copyable components can be journaled");
+    }
+}
+
+inline void registry::journal_write(const auto &...values)
+{
+    // a single copy into the ring buffer
+    std::array<std::byte, (sizeof(values) + ... + 0)> record;
+    auto out = record.data();
+    (..., (std::memcpy(out, &values, sizeof(values)),
+           out += sizeof(values)));
+
+    journal_->write(record.data(), record.size());
+}
+
+template <class C>
+void registry::journal_component(const C &comp)
+{
+    if constexpr (std::is_trivially_copyable_v<C>) {
+        journal_write(persistent_id<C>, std::uint32_t(sizeof(C)));
+        journal_->write(&comp, sizeof(C));
+    }
+}
+
+template <class... Cs>
+registry::size_type registry::replay(std::istream &in)
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+    static_assert((std::is_trivially_copyable_v<Cs> && ...),
+            "only trivially copyable components can be journaled");
+
+    check_thawed();
+
+    if (journal_ != nullptr)
+        throw std::logic_error("cannot replay into a journaled registry");
+
+    // a record cut off by a crash ends the replay
+    struct truncated { };
+    const auto read = [&in](void *dst, size_t bytes)
+    {
+        if (!in.read(static_cast<char *>(dst), bytes))
+            throw truncated{};
+    };
+    const auto read_u32 = [&read]
+    {
+        std::uint32_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    };
+    const auto read_u64 = [&read]
+    {
+        std::uint64_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    };
+    const auto mismatch = []
+    {
+        return std::invalid_argument("journal does not match the registry");
+    };
+    // calls fn with the component type of the hash
+    const auto visit = [](std::uint64_t hash, auto &&fn)
+    {
+        const bool found = (... || (hash == persistent_id<
+                std::remove_cvref_t<Cs>>
+            && (fn(std::type_identity<std::remove_cvref_t<Cs>>{}), true)));
+        if (!found)
+            throw std::invalid_argument("journal component types differ");
+    };
+    const auto existing = [&](std::uint64_t ent)
+    {
+        if (!entities_.contains(ent))
+            throw mismatch();
+        return static_cast<handle_type>(ent);
+    };
+
+    try {
+        if (read_u32() != journal::magic || read_u32() != journal::version)
+            throw std::invalid_argument("not a journal");
+    } catch (const truncated &) {
+        throw std::invalid_argument("not a journal");
+    }
+
+    // the components of a record are read before it is
+    // applied, so a truncated record changes nothing
+    std::pmr::vector<std::pair<std::uint64_t, size_type>> comps(
+            pool_.get());
+    std::pmr::vector<std::byte> bytes(pool_.get());
+    const auto read_components = [&](std::uint32_t count)
+    {
+        comps.clear();
+        bytes.clear();
+        for (; count > 0; --count) {
+            const auto hash = read_u64();
+            const auto size = read_u32();
+            visit(hash, [&]<class C>(std::type_identity<C>)
+            {
+                if (size != sizeof(C))
+                    throw std::invalid_argument(
+                            "journal component types differ");
+            });
+
+            comps.emplace_back(hash, bytes.size());
+            bytes.resize(bytes.size() + size);
+            read(bytes.data() + comps.back().second, size);
+        }
+    };
+    const auto emplace_components = [&](handle_type ent)
+    {
+        for (const auto &[hash, offset] : comps) {
+            visit(hash, [&]<class C>(std::type_identity<C>)
+            {
+                // copying the bytes creates the trivially copyable C
+                alignas(C) std::byte value[sizeof(C)];
+                std::memcpy(value, bytes.data() + offset, sizeof(C));
+                emplace(ent, std::move(*std::launder(
+                        reinterpret_cast<C *>(value))));
+            });
+        }
+    };
+
+    size_type records = 0;
+    for (;; ++records) {
+        journal::op op;
+        if (!in.read(reinterpret_cast<char *>(&op), sizeof(op)))
+            return records;
+
+        try {
+            switch (op) {
+            case journal::op::create: {
+                const auto ent = read_u64();
+                read_components(read_u32());
+                if (entities_.contains(ent))
+                    throw mismatch();
+
+                entities_.emplace(ent,
+                        entinfo(0, component_set(pool_.get())));
+                max_entity_handle_.raise(ent + 1);
+                emplace_components(ent);
+                break;
+            }
+            case journal::op::destroy:
+                destroy(existing(read_u64()));
+                break;
+            case journal::op::emplace: {
+                const auto ent = read_u64();
+                read_components(1);
+                emplace_components(existing(ent));
+                break;
+            }
+            case journal::op::remove: {
+                const auto ent = existing(read_u64());
+                visit(read_u64(), [&]<class C>(std::type_identity<C>)
+                {
+                    remove<C>(ent);
+                });
+                break;
+            }
+            case journal::op::write: {
+                const auto ent = read_u64();
+                read_components(1);
+                visit(comps.front().first, [&]<class C>(std::type_identity<C>)
+                {
+                    std::memcpy(static_cast<void *>(&get<C>(existing(ent))),
+                            bytes.data(), sizeof(C));
+                });
+                break;
+            }
+            case journal::op::clear:
+                clear();
+                break;
+            case journal::op::clear_type:
+                visit(read_u64(), [&]<class C>(std::type_identity<C>)
+                {
+                    clear<C>();
+                });
+                break;
+            default:
+                throw std::invalid_argument("malformed journal");
+            }
+        } catch (const truncated &) {
+            return records;
+        }
+    }
+}
+
+inline void registry::defer_range_updates(bool defer)
+{
+    check_thawed();
+
+    if (!defer)
+        flush_ranges();
+
+    deferred_ = defer;
+}
+
+inline void registry::freeze()
+{
+    check_thawed();
+
+    // readers must not update the ranges
+    flush_ranges();
+    frozen_ = true;
+}
+
+inline void registry::thaw() noexcept
+{
+    frozen_ = false;
+}
+
+inline bool registry::frozen() const noexcept
+{
+    return frozen_;
+}
+
+inline void registry::check_thawed() const
+{
+    if (frozen_)
+        throw std::logic_error("registry is frozen");
+}
+
+template <class... Cs>
+auto registry::read_lock() const
+{
+    return lock_storages<std::shared_lock<std::shared_mutex>, Cs...>();
+}
+
+template <class... Cs>
+auto registry::write_lock() const
+{
+    return lock_storages<std::unique_lock<std::shared_mutex>, Cs...>();
+}
+
+template <class Lock, class... Cs>
+std::array<Lock, sizeof...(Cs)> registry::lock_storages() const
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+
+    const auto mutex = [this](size_type hash) -> std::shared_mutex *
+    {
+        const auto it = components_.find(hash);
+        return it != std::end(components_) ? &it->second->mutex() : nullptr;
+    };
+
+    // locked in the order of their hashes, so threads locking
+    // overlapping types cannot deadlock
+    std::array<std::pair<size_type, std::shared_mutex *>, sizeof...(Cs)>
+        mutexes{ std::pair(detail::type_hash<Cs>(),
+                mutex(detail::type_hash<Cs>()))... };
+    std::ranges::sort(mutexes);
+
+    // types without a storage have no components to guard
+    std::array<Lock, sizeof...(Cs)> locks;
+    for (auto i = 0uz; i < mutexes.size(); ++i) {
+        if (mutexes[i].second != nullptr)
+            locks[i] = Lock(*mutexes[i].second);
+    }
+
+    return locks;
+}
+
+inline void registry::tick()
+{
+    check_thawed();
+
+    ++tick_;
+
+    if (evict_after_ == 0)
+        return;
+
+    std::erase_if(ranges_, [this](const auto &entry)
+    {
+        return tick_ - entry.second.usage.last_used > evict_after_;
+    });
+}
+
+inline registry::size_type registry::current_tick() const noexcept
+{
+    return tick_;
+}
+
+inline registry_stats registry::stats() const
+{
+    registry_stats out;
+
+    out.storages.reserve(components_.size());
+    for (const auto &[hash, stor] : components_)
+        out.storages.push_back(stor->stats());
+
+    out.groups.reserve(groups_.size());
+    for (const auto &[hash, group] : groups_)
+        out.groups.push_back(group->stats());
+
+    out.ranges.reserve(ranges_.size());
+    for (const auto &[hash, range] : ranges_) {
+        auto &stats = out.ranges.emplace_back();
+        stats.types.assign(range.types.begin(), range.types.end());
+        stats.rows = range.views.size() / (range.types.size() + 1);
+        stats.bytes = range.views.capacity() * sizeof(void *)
+            + range.pending_add.capacity() * sizeof(size_type)
+            + detail::node_bytes<size_type>(range.pending_erase)
+            + detail::node_bytes<size_type>(range.types);
+    }
+
+    auto &ents = out.entities;
+    ents.entities = entities_.size();
+    ents.map_bytes = detail::node_bytes<
+            decltype(entities_)::value_type>(entities_);
+    for (const auto &[ent, info] : entities_) {
+        ents.components += info.components.size();
+        ents.component_set_bytes +=
+            detail::node_bytes<component>(info.components);
+    }
+
+    return out;
+}
+
+template <class... Cs>
+group_range<Cs...> registry::group()
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+
+    const auto xor_hash = detail::xor_type_hash<Cs...>();
+
+    if (groups_.contains(xor_hash))
+        return group_range<Cs...>(*groups_.at(xor_hash));
+
+    check_thawed();
+
+    if ((owned_.contains(detail::type_hash<Cs>()) || ...))
+        throw std::logic_error("component owned by another group");
+
+    auto &group = *groups_.emplace(xor_hash, detail::make_pmr<
+            detail::group<std::remove_cvref_t<Cs>...>>(resource_, resource_))
+        .first->second;
+    (..., owned_.emplace(detail::type_hash<Cs>(), &group));
+
+    // move the components of existing entities
+    relocation_map moved(pool_.get());
+    for (const auto &[ent, info] : entities_)
+        adopt(ent, info.components, moved);
+    relocate_views(moved);
+
+    return group_range<Cs...>(group);
+}
+
+template <class... Cs>
+void registry::compact()
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+
+    check_thawed();
+
+    relocation_map moved(pool_.get());
+    const auto record = [&moved](void *from, void *to)
+    {
+        moved.emplace(from, to);
+    };
+
+    const auto compact_storage = [&](size_type hash)
+    {
+        if (components_.contains(hash))
+            components_.at(hash)->compact(record);
+    };
+
+    flush_ranges();
+    (..., compact_storage(detail::type_hash<Cs>()));
+
+    relocate(moved);
+
+    for (auto &[xor_hash, range] : ranges_) {
+        if ((range.types.contains(detail::type_hash<Cs>()) || ...))
+            range.sort();
+    }
+}
+
+inline void registry::relocate(
+    const relocation_map &moved)
+{
+    if (moved.empty())
+        return;
+
+    for (auto &[ent, info] : entities_) {
+        for (const auto &comp : info.components) {
+            if (auto it = moved.find(comp.ptr); it != moved.end())
+                comp.ptr = it->second;
+        }
+    }
+
+    relocate_views(moved);
+}
+
+inline void registry::relocate_views(
+    const relocation_map &moved)
+{
+    if (moved.empty())
+        return;
+
+    for (auto &[xor_hash, range] : ranges_)
+        range.relocate(moved);
+}
+
+inline void registry::adopt(handle_type ent,
+    const component_set &comps,
+    relocation_map &moved)
+{
+    for (auto &[xor_hash, group] : groups_) {
+        if (!group->captures(comps) || group->contains(comps))
+            continue;
+
+        std::pmr::vector<component> previous(pool_.get());
+        previous.reserve(group->types().size());
+        for (const auto hash : group->types())
+            previous.push_back(*comps.find({ hash, 0 }));
+
+        relocation_map grown(pool_.get());
+        group->insert(ent, comps, relocate_member(grown));
+        relocate_views(grown);
+
+        // earlier moves into the group may have been moved
+        // again, as the group grew
+        for (auto &[from, to] : moved) {
+            if (auto it = grown.find(to); it != std::end(grown))
+                to = it->second;
+        }
+
+        // release the moved-from components
+        for (const auto &[hash, ptr] : previous) {
+            moved.emplace(ptr, comps.find({ hash, 0 })->ptr);
+            components_.at(hash)->erase(ptr);
+        }
+    }
+}
+
+inline void registry::leave(detail::basic_group &group,
+    handle_type ent, relocation_map &moved)
+{
+    const auto &comps = entities_.at(ent).components;
+
+    group.leave(comps, [&](size_t hash, void *comp)
+    {
+        auto ptr = components_.at(hash)->move_in(ent, comp);
+        moved.emplace(comp, ptr);
+        return ptr;
+    }, relocate_member(moved));
+}
+
+inline detail::basic_group::relocate_fn registry::relocate_member(
+    relocation_map &moved)
+{
+    return [this, &moved](handle_type owner, void *from, void *to)
+    {
+        for (const auto &comp : entities_.at(owner).components) {
+            if (comp.ptr == from)
+                comp.ptr = to;
+        }
+
+        moved.emplace(from, to);
+    };
+}
+
+template <class C>
+component_range<C>::component_range(
+    detail::storage_type<C> &components,
+    std::span<value_type> grouped)
+    : components_(&components)
+    , grouped_(grouped)
+{
+}
+
+template <class C>
+component_range<C>::component_range(std::span<value_type> grouped)
+    : components_(nullptr)
+    , grouped_(grouped)
 {
 }
 
 template <class C>
 component_range<C>::iterator component_range<C>::begin()
 {
-    return components_.begin();
+    return iterator(components_, components_
+            ? components_->begin().pos() : boost::dynamic_bitset<>::npos,
+            grouped_.data());
 }
 
 template <class C>
 component_range<C>::iterator component_range<C>::end()
 {
-    return components_.end();
+    return iterator(components_, boost::dynamic_bitset<>::npos,
+            grouped_.data() + grouped_.size());
 }
 
 template <class C>
 component_range<C>::const_iterator
 component_range<C>::begin() const
 {
-    return components_.begin();
+    return const_iterator(components_, components_
+            ? components_->begin().pos() : boost::dynamic_bitset<>::npos,
+            grouped_.data());
 }
 
 template <class C>
 component_range<C>::const_iterator
 component_range<C>::end() const
 {
-    return components_.end();
+    return const_iterator(components_, boost::dynamic_bitset<>::npos,
+            grouped_.data() + grouped_.size());
 }
 
 } // namespace ecs
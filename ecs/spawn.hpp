@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ecs/detail/memory.hpp>
+#include <ecs/detail/types.hpp>
+
+namespace ecs {
+
+class registry;
+
+namespace detail {
+
+// staged components of one type, see spawn_buffer
+class basic_stage {
+public:
+    virtual ~basic_stage() = default;
+
+    virtual size_t hash() const noexcept = 0;
+    // moves the component at index into the registry and
+    // returns its address there
+    virtual void *publish(registry &reg, handle_type owner,
+            size_t index) = 0;
+    // destroys a published component, when publishing the
+    // rest of its entity failed
+    virtual void unpublish(registry &reg, void *comp) const = 0;
+    virtual void check_journaled(const registry &reg) const = 0;
+    virtual void journal(registry &reg, const void *comp) const = 0;
+    virtual void clear() noexcept = 0;
+};
+
+template <class C>
+class stage final : public basic_stage {
+public:
+    explicit stage(std::pmr::memory_resource *resource)
+        : items_(resource)
+    {
+    }
+
+    template <class U>
+    size_t push_back(U &&comp)
+    {
+        items_.push_back(std::forward<U>(comp));
+        return items_.size() - 1;
+    }
+
+    size_t hash() const noexcept override { return type_hash<C>(); }
+
+    // defined in registry.hpp
+    void *publish(registry &reg, handle_type owner,
+            size_t index) override;
+    void unpublish(registry &reg, void *comp) const override;
+    void check_journaled(const registry &reg) const override;
+    void journal(registry &reg, const void *comp) const override;
+
+    void clear() noexcept override { items_.clear(); }
+
+private:
+    std::pmr::vector<C> items_;
+};
+
+} // namespace detail
+
+// creates entities from a thread other than the one that
+// owns the registry. Every thread uses its own buffer, which
+// reserves handles in batches without locking and stages
+// the components until registry::publish adds the entities.
+// The staged components are allocated from resource rather
+// than the registry's, since the buffer is used by another
+// thread
+class spawn_buffer {
+public:
+    static constexpr size_t default_batch = 64;
+
+    explicit spawn_buffer(registry &reg, size_t batch = default_batch,
+            std::pmr::memory_resource *resource
+            = std::pmr::get_default_resource());
+    spawn_buffer(const spawn_buffer &) = delete;
+    spawn_buffer &operator=(const spawn_buffer &) = delete;
+
+    template <class... Cs>
+    handle_type create(Cs &&...args);
+
+    // staged entities
+    size_t size() const noexcept { return entities_.size(); }
+    bool empty() const noexcept { return entities_.empty(); }
+
+private:
+    friend class registry;
+
+    struct staged {
+        handle_type ent;
+        size_t xor_hash;
+        // components_[first, first + count)
+        size_t first;
+        size_t count;
+    };
+
+    // reserves the next batch of handles
+    void refill() noexcept;
+    void clear() noexcept;
+
+    registry &reg_;
+    size_t batch_;
+    // reserved handles not yet handed out
+    handle_type next_ = 0;
+    handle_type end_ = 0;
+
+    std::pmr::memory_resource *resource_;
+    std::pmr::vector<staged> entities_;
+    std::pmr::vector<std::pair<detail::basic_stage *, size_t>> components_;
+    std::pmr::unordered_map<size_t,
+            detail::pmr_ptr<detail::basic_stage>> stages_;
+};
+
+inline spawn_buffer::spawn_buffer(registry &reg, size_t batch,
+    std::pmr::memory_resource *resource)
+    : reg_(reg)
+    , batch_(std::max(batch, 1uz))
+    , resource_(resource)
+    , entities_(resource)
+    , components_(resource)
+    , stages_(resource)
+{
+}
+
+template <class... Cs>
+handle_type spawn_buffer::create(Cs &&...args)
+{
+    static_assert(detail::pairwise_distinct<Cs...>);
+
+    if (next_ == end_)
+        refill();
+
+    const handle_type ent = next_++;
+    entities_.push_back({ ent, detail::xor_type_hash<Cs...>(),
+            components_.size(), sizeof...(Cs) });
+
+    const auto push = [&](auto &&arg)
+    {
+        using type = std::remove_cvref_t<decltype(arg)>;
+
+        auto &stage = stages_[detail::type_hash<type>()];
+        if (!stage)
+            stage = detail::make_pmr<detail::stage<type>>(resource_,
+                    resource_);
+
+        auto &typed = static_cast<detail::stage<type> &>(*stage);
+        components_.emplace_back(&typed,
+                typed.push_back(std::forward<decltype(arg)>(arg)));
+    };
+
+    (..., push(std::forward<Cs>(args)));
+
+    return ent;
+}
+
+inline void spawn_buffer::clear() noexcept
+{
+    entities_.clear();
+    components_.clear();
+    for (auto &[hash, stage] : stages_)
+        stage->clear();
+}
+
+} // namespace ecs
+
+// defines the members that use the registry
+#include <ecs/registry.hpp>
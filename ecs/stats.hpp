@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ecs {
+
+// memory of the components of one type outside of groups
+struct storage_stats {
+    size_t hash = 0;
+    // implementation defined, see std::type_info::name
+    std::string name;
+    size_t component_size = 0;
+
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t blocks = 0;
+    // blocks, the bitset of used slots and the owner table
+    size_t bytes = 0;
+    // occupancy[n] is the number of blocks with n used slots,
+    // many sparse blocks call for registry::compact
+    std::vector<size_t> occupancy;
+
+    // used share of the capacity, 1 if there is none
+    double fill() const noexcept
+    {
+        return capacity == 0 ? 1.0 : double(size) / double(capacity);
+    }
+};
+
+// memory of the components owned by a group
+struct group_stats {
+    std::vector<size_t> types;
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t bytes = 0;
+};
+
+// memory of a cached range
+struct range_stats {
+    std::vector<size_t> types;
+    size_t rows = 0;
+    // rows and pending updates
+    size_t bytes = 0;
+};
+
+// bookkeeping of the entities, i.e. the entity map and the
+// component set of every entity. Node sizes of the standard
+// library containers are estimated as the value plus a link
+// and a cached hash
+struct entity_stats {
+    size_t entities = 0;
+    size_t components = 0;
+    size_t map_bytes = 0;
+    size_t component_set_bytes = 0;
+
+    size_t bytes() const noexcept { return map_bytes + component_set_bytes; }
+
+    // bytes per entity, 0 if there are none
+    double per_entity() const noexcept
+    {
+        return entities == 0 ? 0.0 : double(bytes()) / double(entities);
+    }
+};
+
+struct registry_stats {
+    std::vector<storage_stats> storages;
+    std::vector<group_stats> groups;
+    std::vector<range_stats> ranges;
+    entity_stats entities;
+
+    size_t bytes() const noexcept
+    {
+        auto total = entities.bytes();
+        for (const auto &stor : storages)
+            total += stor.bytes;
+        for (const auto &group : groups)
+            total += group.bytes;
+        for (const auto &range : ranges)
+            total += range.bytes;
+        return total;
+    }
+};
+
+namespace detail {
+
+// estimated bytes of a node based container
+template <class Value, class Container>
+size_t node_bytes(const Container &container) noexcept
+{
+    return container.size() * (sizeof(Value) + 2 * sizeof(void *))
+        + container.bucket_count() * sizeof(void *);
+}
+
+} // namespace detail
+} // namespace ecs
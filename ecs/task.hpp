@@ -0,0 +1,465 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ecs/trace.hpp>
+
+namespace ecs {
+
+template <class T = void>
+class task;
+
+namespace detail {
+
+struct final_awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    // continues the awaiting coroutine, if any, on the
+    // thread that finished the task
+    template <class P>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<P> handle) noexcept
+    {
+        if (auto next = handle.promise().continuation)
+            return next;
+        return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept { }
+};
+
+struct basic_promise {
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+};
+
+template <class T>
+struct promise : basic_promise {
+    task<T> get_return_object() noexcept;
+
+    template <class U>
+    void return_value(U &&result)
+    {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T result()
+    {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct promise<void> : basic_promise {
+    task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept { }
+
+    void result() const
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// runs a task to completion on its own, see scheduler::spawn
+struct detached {
+    struct promise_type {
+        detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept { }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+// a coroutine that starts when it is awaited and resumes
+// its awaiter when it returns, see scheduler
+template <class T>
+class task {
+public:
+    using promise_type = detail::promise<T>;
+
+    task(task &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {
+    }
+
+    task &operator=(task &&other) noexcept
+    {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~task()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    auto operator co_await() const noexcept
+    {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return handle.done(); }
+
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<> caller) const noexcept
+            {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+
+            T await_resume() const { return handle.promise().result(); }
+        };
+
+        return awaiter{ handle_ };
+    }
+
+private:
+    friend promise_type;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle_(handle)
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <class T>
+task<T> promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept
+{
+    return task<void>(
+            std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// runs tasks on a fixed set of worker threads. Tasks may
+// await other tasks, the next tick and the chunks of a range
+// without blocking a worker: the awaiting coroutine is
+// resumed by the worker that finishes what it waits for.
+// The scheduler must outlive the tasks it runs
+class scheduler {
+public:
+    static constexpr size_t default_chunk = 1024;
+
+    explicit scheduler(size_t threads = std::max(1u,
+            std::thread::hardware_concurrency()));
+    scheduler(const scheduler &) = delete;
+    scheduler &operator=(const scheduler &) = delete;
+    // resumes the tasks waiting for the next tick, whose
+    // next_tick throws std::runtime_error, runs the queued
+    // jobs, then joins the workers
+    ~scheduler();
+
+    size_t size() const noexcept { return workers_.size(); }
+
+    // starts the task on a worker
+    template <class T>
+    std::future<T> spawn(task<T> job);
+
+    // resumes the awaiting coroutine on a worker
+    auto schedule() noexcept;
+    // resumes the awaiting coroutine on a worker after the
+    // next call to tick, throws std::runtime_error in it if
+    // the scheduler is destroyed first
+    auto next_tick() noexcept;
+    // call along with registry::tick, while no task uses
+    // the registry
+    void tick();
+
+    // calls fn for every element of range, chunk elements
+    // per job, and resumes the awaiting coroutine once all
+    // jobs are done. The range must not change meanwhile
+    template <class R, class F>
+    auto for_each(R &&range, F fn, size_t chunk = default_chunk);
+
+private:
+    // a coroutine suspended in next_tick
+    struct tick_waiter {
+        std::coroutine_handle<> handle;
+        bool cancelled = false;
+    };
+
+    template <class T>
+    detail::detached run(task<T> job, std::promise<T> result);
+
+    void post(std::function<void()> job);
+    void work();
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<tick_waiter *> tick_waiters_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+inline scheduler::scheduler(size_t threads)
+{
+    workers_.reserve(std::max(threads, 1uz));
+    for (auto i = 0uz; i < std::max(threads, 1uz); ++i)
+        workers_.emplace_back([this] { work(); });
+}
+
+inline scheduler::~scheduler()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+
+        // no tick will come, their tasks fail
+        for (const auto waiter : tick_waiters_) {
+            waiter->cancelled = true;
+            jobs_.push_back([handle = waiter->handle] { handle.resume(); });
+        }
+        tick_waiters_.clear();
+    }
+    ready_.notify_all();
+
+    for (auto &worker : workers_)
+        worker.join();
+}
+
+inline void scheduler::post(std::function<void()> job)
+{
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    ready_.notify_one();
+}
+
+inline void scheduler::work()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex_);
+            ready_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        job();
+    }
+}
+
+inline auto scheduler::schedule() noexcept
+{
+    struct awaiter {
+        scheduler &sched;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) const
+        {
+            sched.post([handle] { handle.resume(); });
+        }
+        void await_resume() const noexcept { }
+    };
+
+    return awaiter{ *this };
+}
+
+inline auto scheduler::next_tick() noexcept
+{
+    struct awaiter : tick_waiter {
+        explicit awaiter(scheduler &sched)
+            : sched(sched)
+        {
+        }
+
+        scheduler &sched;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> caller)
+        {
+            std::lock_guard lock(sched.mutex_);
+            // a task started while the scheduler is destroyed
+            // fails at once
+            if (sched.stop_) {
+                cancelled = true;
+                return false;
+            }
+
+            handle = caller;
+            sched.tick_waiters_.push_back(this);
+            return true;
+        }
+        void await_resume() const
+        {
+            if (cancelled)
+                throw std::runtime_error("scheduler destroyed");
+        }
+    };
+
+    return awaiter(*this);
+}
+
+inline void scheduler::tick()
+{
+    std::vector<tick_waiter *> waiters;
+    {
+        std::lock_guard lock(mutex_);
+        waiters.swap(tick_waiters_);
+        for (const auto waiter : waiters)
+            jobs_.push_back([handle = waiter->handle] { handle.resume(); });
+    }
+    ready_.notify_all();
+}
+
+template <class T>
+std::future<T> scheduler::spawn(task<T> job)
+{
+    std::promise<T> result;
+    auto future = result.get_future();
+    run(std::move(job), std::move(result));
+    return future;
+}
+
+template <class T>
+detail::detached scheduler::run(task<T> job, std::promise<T> result)
+{
+    co_await schedule();
+
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await job;
+            result.set_value();
+        } else {
+            result.set_value(co_await job);
+        }
+    } catch (...) {
+        result.set_exception(std::current_exception());
+    }
+}
+
+template <class R, class F>
+auto scheduler::for_each(R &&range, F fn, size_t chunk)
+{
+    using iterator = decltype(std::begin(range));
+
+    struct awaiter {
+        awaiter(scheduler &sched, F &&fn,
+            std::vector<std::pair<iterator, size_t>> &&chunks)
+            : sched(sched)
+            , fn(std::move(fn))
+            , chunks(std::move(chunks))
+        {
+        }
+
+        scheduler &sched;
+        F fn;
+        // first element and number of elements of every job
+        std::vector<std::pair<iterator, size_t>> chunks;
+
+        std::coroutine_handle<> caller;
+        std::atomic<size_t> pending = 0;
+        std::mutex mutex;
+        std::exception_ptr error;
+
+        bool await_ready() const noexcept { return chunks.empty(); }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            caller = handle;
+            const auto count = chunks.size();
+            pending.store(count, std::memory_order_relaxed);
+
+            // the last job may resume the caller and destroy
+            // this awaiter before the loop returns, so it only
+            // reads locals after posting
+            for (auto i = 0uz; i < count; ++i)
+                sched.post([this, i] { run(i); });
+        }
+
+        void await_resume() const
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        void run(size_t index)
+        {
+            ECS_TRACE_SCOPE("for_each chunk");
+            try {
+                auto [it, size] = chunks[index];
+                for (; size > 0; --size, ++it)
+                    fn(*it);
+            } catch (...) {
+                std::lock_guard lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                caller.resume();
+        }
+    };
+
+    chunk = std::max(chunk, 1uz);
+
+    std::vector<std::pair<iterator, size_t>> chunks;
+    auto it = std::begin(range);
+    const auto end = std::end(range);
+    while (it != end) {
+        chunks.emplace_back(it, 0);
+        for (auto &size = chunks.back().second;
+            size < chunk && it != end; ++size)
+        {
+            ++it;
+        }
+    }
+
+    return awaiter(*this, std::move(fn), std::move(chunks));
+}
+
+} // namespace ecs
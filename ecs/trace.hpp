@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// records the time spent in a scope of the library or of a
+// system if ECS_TRACE is defined, otherwise compiles to nothing.
+// name must be a string literal
+#ifdef ECS_TRACE
+#define ECS_TRACE_CONCAT_IMPL(a, b) a##b
+#define ECS_TRACE_CONCAT(a, b) ECS_TRACE_CONCAT_IMPL(a, b)
+#define ECS_TRACE_SCOPE(name) \
+    const ::ecs::trace::scope ECS_TRACE_CONCAT(ecs_trace_, __LINE__)(name)
+#else
+#define ECS_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace ecs::trace {
+
+struct event {
+    const char *name;
+    // nanoseconds of the steady clock
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+// events of one thread. Only the owning thread writes, so
+// recording takes no lock; once full, the oldest events are
+// overwritten. Other threads may read and clear it while it
+// records, like a seqlock: a reader drops the events that
+// were overwritten while it copied them
+class buffer {
+public:
+    static constexpr size_t capacity = 1uz << 14;
+
+    explicit buffer(std::uint32_t thread)
+        : slots_(std::make_unique<slot[]>(capacity))
+        , thread_(thread)
+    {
+    }
+
+    void push(const event &ev) noexcept
+    {
+        const auto index = written_.load(std::memory_order_relaxed);
+        // claim the slot before overwriting it, a reader that
+        // sees a new field sees the claim as well
+        claimed_.store(index + 1, std::memory_order_relaxed);
+
+        auto &slot = slots_[index & (capacity - 1)];
+        slot.name.store(ev.name, std::memory_order_release);
+        slot.begin.store(ev.begin, std::memory_order_release);
+        slot.end.store(ev.end, std::memory_order_release);
+
+        written_.store(index + 1, std::memory_order_release);
+    }
+
+    // the recorded events, oldest first
+    std::vector<event> events() const
+    {
+        const auto written = written_.load(std::memory_order_acquire);
+        const auto first = std::max(cleared_.load(std::memory_order_relaxed),
+                written - std::min(written, capacity));
+
+        std::vector<event> out;
+        out.reserve(written - first);
+        for (auto i = first; i < written; ++i) {
+            const auto &slot = slots_[i & (capacity - 1)];
+            out.push_back({ slot.name.load(std::memory_order_acquire),
+                slot.begin.load(std::memory_order_acquire),
+                slot.end.load(std::memory_order_acquire) });
+        }
+
+        // events whose slot was claimed again meanwhile may
+        // be torn
+        const auto claimed = claimed_.load(std::memory_order_relaxed);
+        const auto valid = claimed - std::min(claimed, capacity);
+        if (valid > first)
+            out.erase(out.begin(), out.begin()
+                    + static_cast<std::ptrdiff_t>(std::min(valid, written) - first));
+
+        return out;
+    }
+
+    // drops the events recorded so far
+    void clear() noexcept
+    {
+        cleared_.store(written_.load(std::memory_order_acquire),
+                std::memory_order_relaxed);
+    }
+
+    std::uint32_t thread() const noexcept { return thread_; }
+
+private:
+    struct slot {
+        std::atomic<const char *> name = nullptr;
+        std::atomic<std::uint64_t> begin = 0;
+        std::atomic<std::uint64_t> end = 0;
+    };
+
+    std::unique_ptr<slot[]> slots_;
+    // events ever claimed and written, the first event that
+    // was not cleared
+    std::atomic<size_t> claimed_ = 0;
+    std::atomic<size_t> written_ = 0;
+    std::atomic<size_t> cleared_ = 0;
+    std::uint32_t thread_;
+};
+
+namespace detail {
+
+struct recorder {
+    std::mutex mutex;
+    // kept after their thread exits, so its events are exported
+    std::vector<std::shared_ptr<buffer>> buffers;
+};
+
+inline recorder &global_recorder()
+{
+    static recorder rec;
+    return rec;
+}
+
+// registers the buffer of the calling thread on first use,
+// the only time recording locks or allocates. nullptr if that
+// failed, the next call tries again
+inline buffer *local_buffer() noexcept
+{
+    thread_local std::shared_ptr<buffer> local;
+    if (local)
+        return local.get();
+
+    try {
+        auto &rec = global_recorder();
+        std::lock_guard lock(rec.mutex);
+        auto buf = std::make_shared<buffer>(
+                static_cast<std::uint32_t>(rec.buffers.size() + 1));
+        rec.buffers.push_back(buf);
+        local = std::move(buf);
+    } catch (...) {
+        // the scope goes unrecorded
+    }
+
+    return local.get();
+}
+
+inline void write_escaped(std::ostream &out, std::string_view name)
+{
+    for (const char c : name) {
+        if (c == '"' || c == '\\')
+            out.put('\\');
+        out.put(c);
+    }
+}
+
+} // namespace detail
+
+inline std::uint64_t now() noexcept
+{
+    return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// records the lifetime of the scope in the buffer of the
+// calling thread, see ECS_TRACE_SCOPE. Neither end throws,
+// a scope whose buffer could not be allocated is dropped
+class scope {
+public:
+    explicit scope(const char *name) noexcept
+        : buffer_(detail::local_buffer())
+        , name_(name)
+        , begin_(now())
+    {
+    }
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+
+    ~scope()
+    {
+        if (buffer_ != nullptr)
+            buffer_->push({ name_, begin_, now() });
+    }
+
+private:
+    buffer *buffer_;
+    const char *name_;
+    std::uint64_t begin_;
+};
+
+/** Writes the recorded events of all threads to out in the
+    Chrome trace event format, which trace viewers such as
+    chrome://tracing or Perfetto open.
+
+    @note Threads may keep recording meanwhile. Events they
+    overwrite while they are exported are left out, so call
+    it between frames to get the frames complete.
+*/
+inline void write_chrome_trace(std::ostream &out)
+{
+    auto &rec = detail::global_recorder();
+    std::lock_guard lock(rec.mutex);
+
+    out << "{\"traceEvents\":[";
+
+    bool first = true;
+    for (const auto &buf : rec.buffers) {
+        for (const auto &ev : buf->events()) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"";
+            detail::write_escaped(out, ev.name);
+            // timestamps in microseconds
+            out << std::format("\",\"ph\":\"X\",\"ts\":{:.3f},"
+                    "\"dur\":{:.3f},\"pid\":1,\"tid\":{}}}",
+                    ev.begin / 1000.0, (ev.end - ev.begin) / 1000.0,
+                    buf->thread());
+            first = false;
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+// drops the events recorded so far, threads may keep
+// recording meanwhile
+inline void clear() noexcept
+{
+    auto &rec = detail::global_recorder();
+    std::lock_guard lock(rec.mutex);
+
+    for (const auto &buf : rec.buffers)
+        buf->clear();
+}
+
+} // namespace ecs::trace
@@ -2,9 +2,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <functional>
+#include <memory_resource>
+#include <numeric>
 #include <span>
 #include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <ecs/detail/types.hpp>
@@ -47,18 +52,55 @@ struct tuple_element<I, ecs::view<Cs...>> {
 
 namespace ecs {
 
+struct range_usage {
+    // registry tick in which the range was last requested
+    size_t last_used = 0;
+    // number of times the range was requested
+    size_t hits = 0;
+};
+
 struct view_range {
-    std::unordered_set<size_t> types;
-    std::vector<void *> views;
+    explicit view_range(std::pmr::memory_resource *resource
+            = std::pmr::get_default_resource());
+
+    std::pmr::unordered_set<size_t> types;
+    std::pmr::vector<void *> views;
+    range_usage usage;
+
+    // deferred updates: entities whose rows are added or
+    // erased when the range is requested next
+    std::pmr::vector<size_t> pending_add;
+    std::pmr::unordered_set<size_t> pending_erase;
 
     size_t size() const noexcept;
     void push_back(size_t entity, std::span<void *> ptrs);
+    static void push_back(std::pmr::vector<void *> &views,
+            size_t entity, std::span<void *> ptrs);
     void erase(size_t entity);
+    void erase(const std::pmr::unordered_set<size_t> &entities);
+    void clear() noexcept;
     bool captures(const component_set &comps) const noexcept;
+
+    void relocate(const relocation_map &moved);
+    void sort();
 };
 
 namespace views {
 
+// rows ahead of the current row whose components are
+// prefetched by prefetch_iterator, if not specified
+constexpr size_t default_prefetch_distance = 8;
+
+// called by prefetch_iterator with the component pointers
+// of every row it prefetches
+struct prefetch_components {
+    void operator()(std::span<void *const> components) const noexcept
+    {
+        for (const auto ptr : components)
+            __builtin_prefetch(ptr);
+    }
+};
+
 template <class... Cs>
 class iterator;
 
@@ -76,7 +118,7 @@ class iterator {
     static constexpr auto stride = sizeof...(Cs);
 public:
     iterator(void **pos,
-        const std::unordered_set<size_t> &types);
+        const std::pmr::unordered_set<size_t> &types);
 
     bool operator==(const iterator &rhs) const noexcept;
     bool operator==(const sentinel &sentinel) const noexcept;
@@ -84,6 +126,8 @@ public:
     iterator operator++();
     iterator operator++(int);
 
+    void **pos() const noexcept { return pos_; }
+
 private:
     void **pos_;
 
@@ -100,8 +144,30 @@ private:
     std::array<size_t, stride> order_;
 };
 
+template <size_t D, class P, class... Cs>
+class prefetch_iterator {
+    static constexpr auto stride = sizeof...(Cs) + 1;
+public:
+    prefetch_iterator(iterator<Cs...> it, void **end, P prefetcher);
+
+    bool operator==(const sentinel &sentinel) const noexcept;
+    view<Cs...> &operator*();
+    prefetch_iterator operator++();
+    prefetch_iterator operator++(int);
+
+private:
+    void prefetch(size_t ahead);
+
+    iterator<Cs...> it_;
+    void **end_;
+    P prefetcher_;
+};
+
 } // namespace views
 
+template <size_t D, class P, class... Cs>
+class prefetching_view_range;
+
 template <class... Cs>
 class typed_view_range {
     // purpose: restore information lost by view_range
@@ -112,10 +178,42 @@ public:
     views::iterator<Cs...> begin() noexcept;
     views::sentinel end() noexcept;
 
+    // prefetcher is called with the components of the row D
+    // rows ahead of the current one, e.g. to also prefetch
+    // data the components point to
+    template <size_t D = views::default_prefetch_distance,
+        class P = views::prefetch_components>
+    prefetching_view_range<D, P, Cs...> prefetch(P prefetcher = {});
+
+private:
+    view_range &range_;
+};
+
+template <size_t D, class P, class... Cs>
+class prefetching_view_range {
+    // purpose: hide the latency of the pointer chase in
+    // view::get when the rows of a range no longer follow
+    // the memory order of the colonies
+    static_assert(D > 0, "prefetch distance must be positive");
+public:
+    prefetching_view_range(view_range &range, P prefetcher);
+
+    views::prefetch_iterator<D, P, Cs...> begin();
+    views::sentinel end() noexcept;
+
 private:
     view_range &range_;
+    P prefetcher_;
 };
 
+inline view_range::view_range(std::pmr::memory_resource *resource)
+    : types(resource)
+    , views(resource)
+    , pending_add(resource)
+    , pending_erase(resource)
+{
+}
+
 inline size_t view_range::size() const noexcept
 {
     return types.size();
@@ -124,7 +222,14 @@ inline size_t view_range::size() const noexcept
 inline void view_range::push_back(
     size_t entity, std::span<void *> ptrs)
 {
-    views.reserve(views.size() + ptrs.size() + 1);
+    push_back(views, entity, ptrs);
+}
+
+inline void view_range::push_back(std::pmr::vector<void *> &views,
+    size_t entity, std::span<void *> ptrs)
+{
+    // let the vector grow geometrically, reserving the
+    // exact size reallocates on every push_back
     views.push_back(reinterpret_cast<void *>(entity));
     views.insert(views.end(), ptrs.rbegin(), ptrs.rend());
 }
@@ -149,6 +254,34 @@ inline void view_range::erase(size_t entity)
     throw std::out_of_range("entity not found");
 }
 
+inline void view_range::erase(
+    const std::pmr::unordered_set<size_t> &entities)
+{
+    // single pass, moving the rows that are kept forward
+    const auto stride = types.size() + 1;
+    auto out = views.begin();
+
+    for (auto row = views.begin(); row != views.end();
+        row += stride)
+    {
+        if (entities.contains(reinterpret_cast<size_t>(*row)))
+            continue;
+
+        if (out != row)
+            std::copy(row, row + stride, out);
+        out += stride;
+    }
+
+    views.erase(out, views.end());
+}
+
+inline void view_range::clear() noexcept
+{
+    views.clear();
+    pending_add.clear();
+    pending_erase.clear();
+}
+
 inline bool view_range::captures(
     const component_set &comps) const noexcept
 {
@@ -164,6 +297,50 @@ inline bool view_range::captures(
 }
 
 
+inline void view_range::relocate(
+    const relocation_map &moved)
+{
+    const auto stride = types.size() + 1;
+
+    for (auto row = 0uz; row < views.size(); row += stride) {
+        // skip the entity
+        for (auto i = row + 1; i < row + stride; ++i) {
+            if (auto it = moved.find(views[i]); it != moved.end())
+                views[i] = it->second;
+        }
+    }
+}
+
+inline void view_range::sort()
+{
+    // order rows by the addresses of their components, so
+    // iterating the range walks the colonies front to back
+    const auto stride = types.size() + 1;
+
+    std::vector<size_t> rows(views.size() / stride);
+    std::iota(rows.begin(), rows.end(), 0uz);
+
+    const auto components = [this, stride](size_t row)
+    {
+        const auto first = views.begin() + row * stride + 1;
+        return std::ranges::subrange(first, first + stride - 1);
+    };
+
+    std::ranges::sort(rows, [&](size_t lhs, size_t rhs)
+    {
+        return std::ranges::lexicographical_compare(
+                components(lhs), components(rhs), std::less<>{});
+    });
+
+    std::pmr::vector<void *> sorted(views.get_allocator());
+    sorted.reserve(views.size());
+    for (const auto row : rows) {
+        const auto first = views.begin() + row * stride;
+        sorted.insert(sorted.end(), first, first + stride);
+    }
+
+    views = std::move(sorted);
+}
 
 template <class... Cs>
 view<Cs...>::view(size_t *order, void **components)
@@ -204,11 +381,46 @@ views::sentinel typed_view_range<Cs...>::end() noexcept
             range_.views.data() + range_.views.size());
 }
 
+template <class... Cs>
+template <size_t D, class P>
+prefetching_view_range<D, P, Cs...>
+typed_view_range<Cs...>::prefetch(P prefetcher)
+{
+    return prefetching_view_range<D, P, Cs...>(
+            range_, std::move(prefetcher));
+}
+
+template <size_t D, class P, class... Cs>
+prefetching_view_range<D, P, Cs...>::prefetching_view_range(
+    view_range &range, P prefetcher)
+    : range_(range)
+    , prefetcher_(std::move(prefetcher))
+{
+}
+
+template <size_t D, class P, class... Cs>
+views::prefetch_iterator<D, P, Cs...>
+prefetching_view_range<D, P, Cs...>::begin()
+{
+    return views::prefetch_iterator<D, P, Cs...>(
+            views::iterator<Cs...>(
+                range_.views.data(), range_.types),
+            range_.views.data() + range_.views.size(),
+            prefetcher_);
+}
+
+template <size_t D, class P, class... Cs>
+views::sentinel prefetching_view_range<D, P, Cs...>::end() noexcept
+{
+    return views::sentinel(
+            range_.views.data() + range_.views.size());
+}
+
 namespace views {
 
 template <class... Cs>
 iterator<Cs...>::iterator(void **pos,
-    const std::unordered_set<size_t> &types)
+    const std::pmr::unordered_set<size_t> &types)
     : pos_(pos)
     , view_(nullptr, nullptr)
 {
@@ -262,6 +474,62 @@ iterator<Cs...> iterator<Cs...>::operator++(int)
     return temp;
 }
 
+template <size_t D, class P, class... Cs>
+prefetch_iterator<D, P, Cs...>::prefetch_iterator(
+    iterator<Cs...> it, void **end, P prefetcher)
+    : it_(it)
+    , end_(end)
+    , prefetcher_(std::move(prefetcher))
+{
+    // warm up: rows 1..D have no predecessor that could
+    // have prefetched them, row 0 is read right away
+    for (auto i = 1uz; i <= D; ++i)
+        prefetch(i);
+}
+
+template <size_t D, class P, class... Cs>
+bool prefetch_iterator<D, P, Cs...>::operator==(
+    const sentinel &sentinel) const noexcept
+{
+    return it_ == sentinel;
+}
+
+template <size_t D, class P, class... Cs>
+view<Cs...> &prefetch_iterator<D, P, Cs...>::operator*()
+{
+    return *it_;
+}
+
+template <size_t D, class P, class... Cs>
+prefetch_iterator<D, P, Cs...> prefetch_iterator<D, P, Cs...>::operator++()
+{
+    ++it_;
+    prefetch(D);
+    return *this;
+}
+
+template <size_t D, class P, class... Cs>
+prefetch_iterator<D, P, Cs...> prefetch_iterator<D, P, Cs...>::operator++(int)
+{
+    prefetch_iterator temp(*this);
+    ++*this;
+    return temp;
+}
+
+template <size_t D, class P, class... Cs>
+void prefetch_iterator<D, P, Cs...>::prefetch(size_t ahead)
+{
+    // rows past the end don't exist, don't read them
+    const auto left = static_cast<size_t>(
+            std::distance(it_.pos(), end_));
+    if (left <= ahead * stride)
+        return;
+
+    // skip the entity handle, prefetch the components
+    void **row = it_.pos() + ahead * stride;
+    prefetcher_(std::span<void *const>(row + 1, stride - 1));
+}
+
 } // namespace views
 } // namespace ecs
 
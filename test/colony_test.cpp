@@ -103,6 +103,93 @@ TEST_CASE("clear and reuse") {
     CHECK(c.at(idx) == "new");
 }
 
+TEST_CASE("erase by pointer releases the slot") {
+    colony<double> c;
+    auto i1 = c.push_back(1);
+    auto i2 = c.push_back(2);
+
+    c.erase(&c.at(i1));
+
+    CHECK(c.size() == 1);
+    CHECK_THROWS_AS(c.at(i1), std::out_of_range);
+    CHECK(*c.begin() == 2);
+
+    // the freed slot is reused instead of growing
+    auto i3 = c.push_back(3);
+    CHECK(i3 == i1);
+    CHECK(c.capacity() == 32);
+    CHECK(c.at(i2) == 2);
+}
+
+TEST_CASE("compact packs elements and releases blocks") {
+    colony<std::string> c;
+    std::vector<colony<std::string>::size_type> ids;
+    for (int i = 0; i < 100; ++i)
+        ids.push_back(c.push_back(std::to_string(i)));
+    for (int i = 0; i < 100; ++i) {
+        if (i % 4 != 0)
+            c.erase(ids[i]);
+    }
+
+    int moved = 0;
+    c.compact([&](size_t from, size_t to) {
+        CHECK(from > to);
+        ++moved;
+    });
+
+    CHECK(c.size() == 25);
+    CHECK(c.capacity() == 32);
+    CHECK(moved == 24);
+
+    std::vector<std::string> result(c.begin(), c.end());
+    for (int i = 0; i < 25; ++i)
+        CHECK(result[i] == std::to_string(i * 4));
+
+    // free slots are still reused
+    auto idx = c.push_back("new");
+    CHECK(idx == 25);
+    CHECK(c.at(idx) == "new");
+}
+
+// Counts the live objects, to catch double destruction
+struct Counted {
+    inline static int live = 0;
+    long long value;
+
+    Counted(int v) : value(v) { ++live; }
+    Counted(const Counted &other) : value(other.value) { ++live; }
+    Counted(Counted &&other) noexcept : value(other.value) { ++live; }
+    Counted &operator=(const Counted &) = default;
+    Counted &operator=(Counted &&) noexcept = default;
+    ~Counted() { --live; }
+};
+
+TEST_CASE("compact destroys every element once") {
+    Counted::live = 0;
+    {
+        colony<Counted> c;
+        std::vector<colony<Counted>::size_type> ids;
+        for (int i = 0; i < 200; ++i)
+            ids.push_back(c.push_back(Counted(i)));
+        for (int i = 0; i < 200; ++i) {
+            if (i % 5 != 0)
+                c.erase(ids[i]);
+        }
+        CHECK(Counted::live == 40);
+
+        c.compact([](size_t, size_t) {});
+        CHECK(Counted::live == 40);
+        CHECK(c.size() == 40);
+
+        int expected = 0;
+        for (const auto &elem : c) {
+            CHECK(elem.value == expected);
+            expected += 5;
+        }
+    }
+    CHECK(Counted::live == 0);
+}
+
 TEST_CASE("capacity and next") {
     colony<double> c;
     auto i1 = c.push_back(100);
@@ -125,3 +212,39 @@ TEST_CASE("const correctness") {
     CHECK(std::is_same_v<decltype(it), colony<double>::const_iterator>);
 }
 
+
+TEST_CASE("clear releases all slots") {
+    colony<double> c;
+    for (int i = 0; i < 40; ++i)
+        c.push_back(i);
+
+    c.clear();
+    CHECK(c.size() == 0);
+    CHECK(c.capacity() == 64);
+    CHECK(c.begin() == c.end());
+    CHECK_THROWS_AS(c.at(0), std::out_of_range);
+
+    for (int i = 0; i < 64; ++i)
+        c.push_back(i);
+    CHECK(c.capacity() == 64);
+}
+
+TEST_CASE("copy keeps elements in their slots") {
+    colony<std::string> c;
+    for (int i = 0; i < 40; ++i)
+        c.push_back(std::to_string(i));
+    for (int i = 0; i < 40; i += 3)
+        c.erase(i);
+
+    colony<std::string> copy(c, std::pmr::get_default_resource());
+    CHECK(copy.size() == c.size());
+    for (auto it = c.begin(); it != c.end(); ++it)
+        CHECK(copy.at(it.pos()) == *it);
+
+    // free slots are reused in both
+    CHECK(copy.push_back("new") == c.push_back("new"));
+
+    const colony<std::string>::address_index index(copy);
+    CHECK(index.position(&copy.at(7)) == 7);
+    CHECK(index.position(&c.at(7)) == boost::dynamic_bitset<>::npos);
+}
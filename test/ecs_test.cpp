@@ -5,6 +5,43 @@
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+// Counts heap allocations while enabled. Every replaceable
+// form of new and delete goes through the pair below. They
+// are not inlined, or the compiler sees free called on a
+// pointer from operator new and warns about the mismatch
+namespace alloc_counter {
+inline bool enabled = false;
+inline size_t count = 0;
+
+[[gnu::noinline]] inline void* allocate(size_t size) {
+    if (enabled)
+        ++count;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] inline void deallocate(void* ptr) noexcept {
+    std::free(ptr);
+}
+}
+
+void* operator new(size_t size) { return alloc_counter::allocate(size); }
+void* operator new[](size_t size) { return alloc_counter::allocate(size); }
+void operator delete(void* ptr) noexcept { alloc_counter::deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { alloc_counter::deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { alloc_counter::deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { alloc_counter::deallocate(ptr); }
 
 // Test components
 struct position {
@@ -41,6 +78,35 @@ struct damage {
     damage(float amt = 0.0f) : amount(amt) {}
 };
 
+// Counts the live objects, to catch double destruction
+struct tracked {
+    inline static int live = 0;
+    ecs::handle_type id;
+    tracked(ecs::handle_type id) : id(id) { ++live; }
+    tracked(const tracked& other) : id(other.id) { ++live; }
+    tracked(tracked&& other) noexcept : id(other.id) { ++live; }
+    tracked& operator=(const tracked&) = default;
+    tracked& operator=(tracked&&) noexcept = default;
+    ~tracked() { --live; }
+};
+
+// Throws when it is moved while armed, if asked to
+struct fragile {
+    inline static bool armed = false;
+    bool fail = false;
+    void* padding = nullptr;
+    fragile(bool fail) : fail(fail) {}
+    fragile(fragile&& other) : fail(other.fail) {
+        if (armed && fail)
+            throw std::runtime_error("fragile");
+    }
+    fragile& operator=(fragile&&) = default;
+};
+
+// Saved under a chosen id instead of one derived from its name
+template <>
+constexpr std::uint64_t ecs::persistent_id<damage> = 0x444d47;
+
 // Singleton for testing
 struct world_time {
     float delta_time;
@@ -526,3 +592,1556 @@ TEST_CASE("Edge Cases and Robustness") {
         CHECK(ecs::get<position>(reg, ent3) == position(6.0f, 6.0f));
     }
 }
+
+TEST_CASE("Prefetched Range Iteration") {
+    ecs::registry reg;
+
+    std::vector<ecs::handle_type> entities;
+    for (int i = 0; i < 100; ++i) {
+        entities.push_back(ecs::create(reg,
+            position(static_cast<float>(i), 0.0f), velocity(1.0f, 0.0f)));
+    }
+
+    // punch holes so new components land out of row order
+    for (int i = 0; i < 100; i += 3) {
+        ecs::destroy(reg, entities[i]);
+    }
+    for (int i = 0; i < 10; ++i) {
+        ecs::create(reg, position(1000.0f, 0.0f), velocity(1.0f, 0.0f));
+    }
+
+    SUBCASE("Visits the same tuples as range") {
+        std::vector<float> plain;
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            plain.push_back(pos.x + vel.dx);
+        }
+
+        std::vector<float> prefetched;
+        for (auto& [pos, vel] : ecs::prefetched_range<4, position, velocity>(reg)) {
+            prefetched.push_back(pos.x + vel.dx);
+        }
+
+        CHECK(plain.size() == 76);
+        CHECK(prefetched == plain);
+    }
+
+    SUBCASE("Prefetches every row after the first once") {
+        std::vector<const void* const*> rows;
+        auto record = [&rows](std::span<void* const> components) {
+            CHECK(components.size() == 2);
+            rows.push_back(components.data());
+        };
+
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg).prefetch<4>(record)) {
+            pos.x += vel.dx;
+        }
+
+        REQUIRE(rows.size() == 75);
+        std::ranges::sort(rows);
+        // consecutive rows of an entity and two components
+        for (size_t i = 1; i < rows.size(); ++i)
+            CHECK(rows[i] - rows[i - 1] == 3);
+    }
+
+    SUBCASE("Distance larger than the range") {
+        int count = 0;
+        for (auto& [vel, pos] : ecs::prefetched_range<1024, velocity, position>(reg)) {
+            pos.x += vel.dx;
+            ++count;
+        }
+        CHECK(count == 76);
+    }
+}
+
+TEST_CASE("Optimize and Compact") {
+    ecs::registry reg;
+
+    std::vector<ecs::handle_type> entities;
+    for (int i = 0; i < 200; ++i) {
+        auto ent = ecs::create(reg, position(static_cast<float>(i), 0.0f),
+            velocity(0.0f, static_cast<float>(i)));
+        ecs::emplace<health>(reg, ent, static_cast<float>(i), 100.0f);
+        entities.push_back(ent);
+    }
+
+    // build the range before churning, so its rows get patched
+    ecs::range<position, velocity>(reg);
+
+    std::vector<ecs::handle_type> alive;
+    for (int i = 0; i < 200; ++i) {
+        if (i % 3 == 0)
+            alive.push_back(entities[i]);
+        else
+            ecs::destroy(reg, entities[i]);
+    }
+
+    const auto check_alive = [&] {
+        for (auto ent : alive) {
+            const auto i = static_cast<float>(ent - entities.front());
+            CHECK(ecs::get<position>(reg, ent).x == i);
+            CHECK(ecs::get<velocity>(reg, ent).dy == i);
+            CHECK(ecs::get<health>(reg, ent).current == i);
+            CHECK(ecs::get<health>(reg, ent).owner == ent);
+        }
+
+        int count = 0;
+        const position *last = nullptr;
+        bool ordered = true;
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            CHECK(pos.x == vel.dy);
+            ordered = ordered && (last == nullptr || last < &pos);
+            last = &pos;
+            ++count;
+        }
+        CHECK(count == static_cast<int>(alive.size()));
+        return ordered;
+    };
+
+    SUBCASE("Optimize everything") {
+        ecs::optimize(reg);
+        CHECK(check_alive());
+
+        for (auto& hp : ecs::range<health>(reg)) {
+            CHECK(ecs::sibling<position>(reg, hp).x == hp.current);
+        }
+    }
+
+    SUBCASE("Compact a single type") {
+        ecs::compact<position>(reg);
+        check_alive();
+    }
+
+    SUBCASE("Components are destroyed once") {
+        {
+            ecs::registry counted;
+            std::vector<ecs::handle_type> ents;
+            for (int i = 0; i < 200; ++i)
+                ents.push_back(ecs::create(counted, tracked(ecs::handle_type(i))));
+            for (int i = 0; i < 200; ++i) {
+                if (i % 5 != 0)
+                    ecs::destroy(counted, ents[i]);
+            }
+            CHECK(tracked::live == 40);
+
+            ecs::optimize(counted);
+            CHECK(tracked::live == 40);
+            for (int i = 0; i < 200; i += 5)
+                CHECK(ecs::get<tracked>(counted, ents[i]).id == ecs::handle_type(i));
+        }
+        CHECK(tracked::live == 0);
+    }
+
+    SUBCASE("Entities created afterwards") {
+        ecs::optimize(reg);
+        auto ent = ecs::create(reg, position(-1.0f, 0.0f), velocity(0.0f, -1.0f));
+        CHECK(ecs::get<position>(reg, ent).x == -1.0f);
+
+        int count = 0;
+        for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            ++count;
+        }
+        CHECK(count == static_cast<int>(alive.size()) + 1);
+    }
+}
+
+TEST_CASE("Owning Groups") {
+    ecs::registry reg;
+
+    std::vector<ecs::handle_type> movers;
+    for (int i = 0; i < 50; ++i) {
+        movers.push_back(ecs::create(reg,
+            position(static_cast<float>(i), 0.0f),
+            velocity(static_cast<float>(i), 0.0f)));
+    }
+    auto still = ecs::create(reg, position(-1.0f, 0.0f));
+
+    // the range exists before the group and has to follow it
+    ecs::range<velocity, position>(reg);
+
+    const auto sum = [](auto &&range) {
+        int count = 0;
+        bool matching = true;
+        for (auto& [pos, vel] : range) {
+            matching = matching && pos.x == vel.dx;
+            ++count;
+        }
+        return matching ? count : -1;
+    };
+
+    SUBCASE("Declaring adopts existing entities") {
+        auto group = ecs::group<position, velocity>(reg);
+        CHECK(group.size() == 50);
+        CHECK(sum(group) == 50);
+        CHECK(sum(ecs::range<position, velocity>(reg)) == 50);
+
+        // same group, other order
+        int count = 0;
+        for (auto& [vel, pos] : ecs::group<velocity, position>(reg)) {
+            CHECK(pos.x == vel.dx);
+            ++count;
+        }
+        CHECK(count == 50);
+
+        CHECK(ecs::get<position>(reg, movers[7]).x == 7.0f);
+        CHECK(ecs::get<position>(reg, still).x == -1.0f);
+    }
+
+    SUBCASE("Types can only be owned once") {
+        ecs::group<position, velocity>(reg);
+        CHECK_THROWS_AS((ecs::group<position, health>(reg)), std::logic_error);
+    }
+
+    SUBCASE("Create, emplace and destroy keep the group packed") {
+        ecs::group<position, velocity>(reg);
+
+        // growing the arrays moves every member
+        for (int i = 50; i < 100; ++i) {
+            movers.push_back(ecs::create(reg,
+                position(static_cast<float>(i), 0.0f),
+                velocity(static_cast<float>(i), 0.0f)));
+        }
+        ecs::emplace<velocity>(reg, still, -1.0f, 0.0f);
+
+        for (int i = 0; i < 100; i += 2) {
+            ecs::destroy(reg, movers[i]);
+        }
+
+        CHECK(ecs::group<position, velocity>(reg).size() == 51);
+        CHECK(sum(ecs::group<position, velocity>(reg)) == 51);
+        CHECK(sum(ecs::range<position, velocity>(reg)) == 51);
+
+        for (int i = 1; i < 100; i += 2) {
+            CHECK(ecs::get<position>(reg, movers[i]).x == static_cast<float>(i));
+            CHECK(ecs::get<velocity>(reg, movers[i]).dx == static_cast<float>(i));
+        }
+        CHECK(ecs::get<velocity>(reg, still).dx == -1.0f);
+
+        // grouped and ungrouped positions alike
+        int count = 0;
+        float sum = 0.0f;
+        for (auto& pos : ecs::range<position>(reg)) {
+            sum += pos.x;
+            ++count;
+        }
+        CHECK(count == 51);
+        CHECK(sum == 2500.0f - 1.0f);
+    }
+
+    SUBCASE("Members keep their other components") {
+        auto ent = ecs::create(reg, position(3.0f, 0.0f));
+        ecs::emplace<health>(reg, ent, 10.0f, 10.0f);
+        ecs::group<position, velocity>(reg);
+
+        auto& vel = ecs::emplace<velocity>(reg, ent, 3.0f, 0.0f);
+        CHECK(vel.dx == 3.0f);
+        CHECK(ecs::sibling<position>(reg, ecs::get<health>(reg, ent)).x == 3.0f);
+
+        ecs::destroy(reg, ent);
+        CHECK(sum(ecs::group<position, velocity>(reg)) == 50);
+        CHECK(ecs::range<health>(reg).begin() == ecs::range<health>(reg).end());
+    }
+}
+
+TEST_CASE("Emplace Completing a Tuple") {
+    ecs::registry reg;
+    auto ent = ecs::create(reg, position(1.0f, 0.0f), name("a"));
+    ecs::create(reg, position(2.0f, 0.0f), velocity(2.0f, 0.0f));
+
+    // range exists before the tuple is complete
+    int count = 0;
+    for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        ++count;
+    }
+    CHECK(count == 1);
+
+    ecs::emplace<velocity>(reg, ent, 1.0f, 0.0f);
+    ecs::create(reg, position(3.0f, 0.0f), velocity(3.0f, 0.0f));
+
+    count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == vel.dx);
+        ++count;
+    }
+    CHECK(count == 3);
+}
+
+TEST_CASE("Uncached Each") {
+    ecs::registry reg;
+    for (int i = 0; i < 20; ++i) {
+        auto ent = ecs::create(reg, position(float(i), 0.0f));
+        if (i % 4 == 0)
+            ecs::emplace<velocity>(reg, ent, float(i), 0.0f);
+        if (i % 2 == 0)
+            ecs::emplace<health>(reg, ent, float(i));
+    }
+
+    int count = 0;
+    ecs::each<health, position, velocity>(reg,
+        [&](health& hp, position& pos, velocity& vel) {
+            CHECK(hp.current == pos.x);
+            CHECK(pos.x == vel.dx);
+            vel.dy = 1.0f;
+            ++count;
+        });
+    CHECK(count == 5);
+
+    for (auto& vel : ecs::range<velocity>(reg)) {
+        CHECK(vel.dy == 1.0f);
+    }
+
+    // no component of this type exists
+    count = 0;
+    ecs::each<position, damage>(reg, [&](position&, damage&) { ++count; });
+    CHECK(count == 0);
+
+    // grouped components are found as well
+    ecs::group<position, velocity>(reg);
+    count = 0;
+    ecs::each<velocity, health>(reg, [&](velocity& vel, health& hp) {
+        CHECK(vel.dx == hp.current);
+        ++count;
+    });
+    CHECK(count == 5);
+}
+
+TEST_CASE("Range Usage and Eviction") {
+    ecs::registry reg;
+    ecs::create(reg, position(1.0f, 0.0f), velocity(1.0f, 0.0f), health());
+
+    CHECK_FALSE(ecs::usage<position, velocity>(reg).has_value());
+    ecs::range<position, velocity>(reg);
+    ecs::range<velocity, position>(reg);
+    ecs::range<position, health>(reg);
+
+    auto usage = ecs::usage<position, velocity>(reg);
+    REQUIRE(usage.has_value());
+    CHECK(usage->hits == 2);
+    CHECK(usage->last_used == 0);
+
+    CHECK(ecs::release_range<position, health>(reg));
+    CHECK_FALSE(ecs::release_range<position, health>(reg));
+
+    // released ranges are rebuilt on demand
+    ecs::create(reg, position(), health());
+    int count = 0;
+    for ([[maybe_unused]] auto& [pos, hp] : ecs::range<position, health>(reg)) {
+        ++count;
+    }
+    CHECK(count == 2);
+
+    ecs::evict_ranges_after(reg, 2);
+    ecs::tick(reg);
+    ecs::tick(reg);
+    ecs::range<position, velocity>(reg);
+    ecs::tick(reg);
+
+    CHECK(ecs::usage<position, velocity>(reg)->last_used == 2);
+    CHECK_FALSE(ecs::usage<position, health>(reg).has_value());
+
+    ecs::tick(reg);
+    CHECK(ecs::usage<position, velocity>(reg).has_value());
+    ecs::tick(reg);
+    CHECK_FALSE(ecs::usage<position, velocity>(reg).has_value());
+}
+
+TEST_CASE("Deferred Range Updates") {
+    ecs::registry reg;
+    ecs::create(reg, position(0.0f, 0.0f), velocity(0.0f, 0.0f));
+    ecs::range<position, velocity>(reg);
+
+    ecs::defer_range_updates(reg, true);
+
+    std::vector<ecs::handle_type> ents;
+    for (int i = 1; i < 100; ++i) {
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f),
+                velocity(float(i), 0.0f)));
+    }
+
+    // created and destroyed before the range is requested
+    ecs::destroy(reg, ents[10]);
+    auto late = ecs::create(reg, position(7.0f, 0.0f));
+    ecs::emplace<velocity>(reg, late, 7.0f, 0.0f);
+
+    int count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == vel.dx);
+        ++count;
+    }
+    CHECK(count == 100);
+
+    for (int i = 0; i < 50; ++i) {
+        ecs::destroy(reg, ents[i + 20]);
+    }
+    ecs::optimize(reg);
+
+    count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == vel.dx);
+        ++count;
+    }
+    CHECK(count == 50);
+
+    ecs::destroy(reg, late);
+    ecs::defer_range_updates(reg, false);
+    ecs::create(reg, position(1.0f, 0.0f), velocity(1.0f, 0.0f));
+
+    count = 0;
+    for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        ++count;
+    }
+    CHECK(count == 50);
+}
+
+TEST_CASE("Prebuilt Ranges") {
+    ecs::registry reg;
+    for (int i = 0; i < 40000; ++i) {
+        if (i % 3 == 0)
+            ecs::create(reg, position(float(i), 0.0f), velocity(float(i), 0.0f));
+        else if (i % 3 == 1)
+            ecs::create(reg, position(float(i), 0.0f), health(float(i)));
+        else
+            ecs::create(reg, velocity(float(i), 0.0f), health(float(i)));
+    }
+
+    ecs::prebuild<std::tuple<position, velocity>,
+            std::tuple<health, position>>(reg);
+    REQUIRE(ecs::usage<position, velocity>(reg).has_value());
+    REQUIRE(ecs::usage<position, health>(reg).has_value());
+
+    int count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == vel.dx);
+        ++count;
+    }
+    CHECK(count == 13334);
+
+    ecs::prebuild<std::tuple<velocity, health>>(reg);
+    count = 0;
+    for (auto& [vel, hp] : ecs::range<velocity, health>(reg)) {
+        CHECK(vel.dx == hp.current);
+        ++count;
+    }
+    CHECK(count == 13333);
+}
+
+TEST_CASE("Allocation Free Steady State") {
+    ecs::registry reg;
+    ecs::range<position, velocity>(reg);
+    ecs::range<velocity, health>(reg);
+
+    const auto cycle = [&reg] {
+        std::array<ecs::handle_type, 256> ents;
+        for (size_t i = 0; i < ents.size(); ++i) {
+            ents[i] = ecs::create(reg, position(1.0f, 2.0f), velocity());
+            if (i % 2 == 0)
+                ecs::emplace<health>(reg, ents[i], 50.0f);
+        }
+        for (auto ent : ents)
+            ecs::destroy(reg, ent);
+    };
+
+    SUBCASE("ranges") {
+        cycle();
+        cycle();
+
+        alloc_counter::count = 0;
+        alloc_counter::enabled = true;
+        cycle();
+        alloc_counter::enabled = false;
+        CHECK(alloc_counter::count == 0);
+    }
+
+    SUBCASE("groups") {
+        ecs::group<position, health>(reg);
+        cycle();
+        cycle();
+
+        alloc_counter::count = 0;
+        alloc_counter::enabled = true;
+        cycle();
+        alloc_counter::enabled = false;
+        CHECK(alloc_counter::count == 0);
+    }
+}
+
+// Allocates with malloc, so it is not seen by alloc_counter
+class counting_resource : public std::pmr::memory_resource {
+public:
+    size_t allocated = 0;
+    size_t outstanding = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated += bytes;
+        outstanding += bytes;
+        const auto size = (bytes + alignment - 1) / alignment * alignment;
+        return std::aligned_alloc(alignment, size ? size : alignment);
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t) override {
+        outstanding -= bytes;
+        std::free(ptr);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST_CASE("Custom Memory Resource") {
+    counting_resource resource;
+
+    {
+        ecs::registry reg(&resource);
+        ecs::singleton(reg, world_time(1.0f, 0.0f));
+        ecs::create(reg, position(), velocity(), health());
+        ecs::range<position, velocity>(reg);
+        ecs::group<velocity, health>(reg);
+
+        alloc_counter::count = 0;
+        alloc_counter::enabled = true;
+        for (int i = 0; i < 1000; ++i) {
+            auto ent = ecs::create(reg, position(float(i), 0.0f), velocity());
+            ecs::emplace<health>(reg, ent, float(i));
+        }
+        alloc_counter::enabled = false;
+
+        // components, rows and entities all come from resource
+        CHECK(alloc_counter::count == 0);
+
+        // so do new storages, groups and registries
+        alloc_counter::count = 0;
+        alloc_counter::enabled = true;
+        ecs::create(reg, name{ "storage" });
+        ecs::group<position, name>(reg);
+        {
+            ecs::registry other(&resource);
+            ecs::create(other, position());
+        }
+        alloc_counter::enabled = false;
+        CHECK(alloc_counter::count == 0);
+
+        // clones keep their storages and groups in resource
+        const auto outstanding = resource.outstanding;
+        {
+            auto copy = ecs::clone(reg);
+            CHECK(resource.outstanding > outstanding);
+        }
+        CHECK(resource.outstanding == outstanding);
+        CHECK(resource.allocated > 1000 * (sizeof(position) + sizeof(health)));
+        CHECK(ecs::singleton<world_time>(reg).delta_time == 1.0f);
+
+        int count = 0;
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            CHECK(vel.dx == 0.0f);
+            ++count;
+        }
+        CHECK(count == 1001);
+    }
+
+    CHECK(resource.outstanding == 0);
+}
+
+TEST_CASE("Clear") {
+    ecs::registry reg;
+    ecs::singleton(reg, world_time());
+
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 100; ++i) {
+        auto ent = ecs::create(reg, position(float(i), 0.0f), velocity(float(i), 0.0f));
+        if (i % 2 == 0)
+            ecs::emplace<health>(reg, ent, float(i));
+        ents.push_back(ent);
+    }
+    ecs::range<position, velocity>(reg);
+    ecs::range<position, health>(reg);
+
+    SUBCASE("all") {
+        ecs::group<velocity, health>(reg);
+        ecs::clear(reg);
+
+        CHECK_FALSE(ecs::contains(reg, ents.front()));
+        CHECK(ecs::range<position, velocity>(reg).begin()
+                == ecs::range<position, velocity>(reg).end());
+        CHECK(ecs::group<velocity, health>(reg).size() == 0);
+        CHECK(ecs::range<position>(reg).begin() == ecs::range<position>(reg).end());
+        CHECK_NOTHROW(ecs::singleton<world_time>(reg));
+
+        // the registry is usable as before
+        ecs::create(reg, position(1.0f, 0.0f), velocity(1.0f, 0.0f), health(1.0f));
+        int count = 0;
+        for (auto& [vel, hp] : ecs::group<velocity, health>(reg)) {
+            CHECK(vel.dx == hp.current);
+            ++count;
+        }
+        CHECK(count == 1);
+    }
+
+    SUBCASE("one type") {
+        ecs::clear<velocity>(reg);
+
+        CHECK(ecs::contains(reg, ents.front()));
+        CHECK_THROWS_AS(ecs::get<velocity>(reg, ents.front()), std::invalid_argument);
+        CHECK(ecs::get<position>(reg, ents.front()).x == 0.0f);
+
+        int count = 0;
+        for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            ++count;
+        }
+        CHECK(count == 0);
+
+        for (auto& [pos, hp] : ecs::range<position, health>(reg)) {
+            CHECK(pos.x == hp.current);
+            ++count;
+        }
+        CHECK(count == 50);
+
+        ecs::emplace<velocity>(reg, ents[3], 3.0f, 0.0f);
+        count = 0;
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            CHECK(pos.x == vel.dx);
+            ++count;
+        }
+        CHECK(count == 1);
+    }
+
+    SUBCASE("grouped type") {
+        ecs::group<position, health>(reg);
+        ecs::clear<health>(reg);
+
+        CHECK(ecs::group<position, health>(reg).size() == 0);
+
+        int count = 0;
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+            CHECK(pos.x == vel.dx);
+            ++count;
+        }
+        CHECK(count == 100);
+
+        for (auto ent : ents) {
+            ecs::destroy(reg, ent);
+        }
+        CHECK(ecs::range<position>(reg).begin() == ecs::range<position>(reg).end());
+    }
+}
+
+TEST_CASE("Destroy If") {
+    ecs::registry reg;
+
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 200; ++i) {
+        auto ent = ecs::create(reg, position(float(i), 0.0f), health(float(i % 10)));
+        if (i % 3 == 0)
+            ecs::emplace<velocity>(reg, ent, float(i), 0.0f);
+        ents.push_back(ent);
+    }
+    ecs::range<position, velocity>(reg);
+    ecs::range<health, position>(reg);
+
+    SUBCASE("single type") {
+        auto count = ecs::destroy_if<health>(reg, [](const health& hp) {
+            return hp.current == 0.0f;
+        });
+        CHECK(count == 20);
+        CHECK_FALSE(ecs::contains(reg, ents[0]));
+        CHECK_FALSE(ecs::contains(reg, ents[190]));
+        CHECK(ecs::contains(reg, ents[1]));
+    }
+
+    SUBCASE("grouped") {
+        ecs::group<position, health>(reg);
+        auto count = ecs::destroy_if<health>(reg, [](const health& hp) {
+            return hp.current < 5.0f;
+        });
+        CHECK(count == 100);
+        CHECK(ecs::group<position, health>(reg).size() == 100);
+    }
+
+    SUBCASE("tuple") {
+        auto count = ecs::destroy_if<velocity, position>(reg,
+            [](const velocity&, const position& pos) {
+                return pos.x < 100.0f;
+            });
+        CHECK(count == 34);
+        CHECK_FALSE(ecs::contains(reg, ents[99]));
+        CHECK(ecs::contains(reg, ents[98]));
+    }
+
+    // the survivors are intact
+    int count = 0;
+    for (auto& [hp, pos] : ecs::range<health, position>(reg)) {
+        CHECK(hp.current == float(int(pos.x) % 10));
+        CHECK(ecs::contains(reg, ents[int(pos.x)]));
+        ++count;
+    }
+    int velocities = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == vel.dx);
+        ++velocities;
+    }
+    int positions = 0;
+    for ([[maybe_unused]] auto& pos : ecs::range<position>(reg)) {
+        ++positions;
+    }
+    CHECK(positions == count);
+    CHECK(velocities <= count);
+
+    // freed slots are reused
+    ecs::create(reg, position(), health());
+}
+
+TEST_CASE("Snapshot Save and Load") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 100; ++i) {
+        auto ent = ecs::create(reg, position(float(i), 1.0f));
+        if (i % 2 == 0)
+            ecs::emplace<velocity>(reg, ent, float(i), 2.0f);
+        if (i % 5 == 0)
+            ecs::emplace<damage>(reg, ent, float(i));
+        ents.push_back(ent);
+    }
+    auto empty = ecs::create(reg);
+    ecs::destroy(reg, ents[7]);
+    ecs::group<position, damage>(reg);
+
+    std::stringstream stream;
+    ecs::save<position, velocity, damage>(reg, stream);
+
+    ecs::registry copy;
+    ecs::range<position, velocity>(copy);
+    ecs::group<velocity, damage>(copy);
+    ecs::load<position, velocity, damage>(copy, stream);
+
+    CHECK(ecs::contains(copy, empty));
+    CHECK_FALSE(ecs::contains(copy, ents[7]));
+    for (int i = 0; i < 100; ++i) {
+        if (i == 7)
+            continue;
+        CHECK(ecs::get<position>(copy, ents[i]).x == float(i));
+        if (i % 2 == 1)
+            CHECK_THROWS_AS(ecs::get<velocity>(copy, ents[i]), std::invalid_argument);
+    }
+
+    int count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(copy)) {
+        CHECK(pos.x == vel.dx);
+        ++count;
+    }
+    CHECK(count == 50);
+
+    for (auto& [vel, dmg] : ecs::group<velocity, damage>(copy)) {
+        CHECK(vel.dx == dmg.amount);
+        CHECK(ecs::get<position>(copy, dmg.owner).x == dmg.amount);
+    }
+    CHECK(ecs::group<velocity, damage>(copy).size() == 10);
+
+    // new handles do not collide with loaded ones
+    auto ent = ecs::create(copy, position());
+    CHECK(std::find(ents.begin(), ents.end(), ent) == ents.end());
+
+    std::stringstream wrong;
+    ecs::save<position, velocity>(reg, wrong);
+    CHECK_THROWS_AS((ecs::load<position, damage>(copy, wrong)), std::invalid_argument);
+
+    std::stringstream truncated(stream.str().substr(0, 40));
+    CHECK_THROWS_AS((ecs::load<position, velocity, damage>(copy, truncated)),
+            std::runtime_error);
+
+    // types are stored by their persistent ids
+    static_assert(ecs::persistent_id<position> != ecs::persistent_id<velocity>);
+    const auto bytes = stream.str();
+    const std::uint64_t id = 0x444d47;
+    CHECK(bytes.find(std::string(reinterpret_cast<const char*>(&id), sizeof(id)))
+            != std::string::npos);
+
+    // counts beyond the end of the stream fail before anything
+    // is allocated for them, here the number of entities
+    auto corrupt = bytes;
+    const std::uint64_t huge = std::uint64_t(1) << 40;
+    std::memcpy(corrupt.data() + 24, &huge, sizeof(huge));
+    std::stringstream corrupted(corrupt);
+    CHECK_THROWS_AS((ecs::load<position, velocity, damage>(copy, corrupted)),
+            std::runtime_error);
+}
+
+TEST_CASE("Remove Component") {
+    ecs::registry reg;
+    auto a = ecs::create(reg, position(1.0f, 0.0f), velocity(1.0f, 0.0f), health(1.0f));
+    auto b = ecs::create(reg, position(2.0f, 0.0f), velocity(2.0f, 0.0f), health(2.0f));
+    ecs::range<position, velocity>(reg);
+    ecs::group<velocity, health>(reg);
+
+    ecs::remove<velocity>(reg, a);
+    CHECK_THROWS_AS(ecs::get<velocity>(reg, a), std::invalid_argument);
+    CHECK_THROWS_AS(ecs::remove<velocity>(reg, a), std::invalid_argument);
+    CHECK(ecs::get<health>(reg, a).current == 1.0f);
+    CHECK(ecs::group<velocity, health>(reg).size() == 1);
+
+    int count = 0;
+    for (auto& [pos, vel] : ecs::range<position, velocity>(reg)) {
+        CHECK(pos.x == 2.0f);
+        CHECK(vel.dx == 2.0f);
+        ++count;
+    }
+    CHECK(count == 1);
+
+    ecs::emplace<velocity>(reg, a, 1.0f, 0.0f);
+    count = 0;
+    for (auto& [vel, hp] : ecs::group<velocity, health>(reg)) {
+        CHECK(vel.dx == hp.current);
+        ++count;
+    }
+    CHECK(count == 2);
+    ecs::destroy(reg, b);
+}
+
+TEST_CASE("Delta Encoding") {
+    ecs::registry server;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 50; ++i) {
+        auto ent = ecs::create(server, position(float(i), 0.0f), velocity(1.0f, 0.0f));
+        if (i % 5 == 0)
+            ecs::emplace<damage>(server, ent, float(i));
+        ents.push_back(ent);
+    }
+
+    // both sides start from the same snapshot
+    std::stringstream snapshot;
+    ecs::save<position, velocity, damage>(server, snapshot);
+    ecs::registry baseline;
+    ecs::load<position, velocity, damage>(baseline, snapshot);
+    snapshot.seekg(0);
+    ecs::registry client;
+    ecs::load<position, velocity, damage>(client, snapshot);
+    ecs::range<position, velocity>(client);
+
+    // a tick on the server
+    for (auto& [pos, vel] : ecs::range<position, velocity>(server)) {
+        if (int(pos.x) % 2 == 0)
+            pos.x += vel.dx;
+    }
+    ecs::destroy(server, ents[3]);
+    ecs::remove<velocity>(server, ents[4]);
+    ecs::emplace<damage>(server, ents[6], 6.0f);
+    auto spawned = ecs::create(server, position(100.0f, 0.0f), damage(7.0f));
+
+    std::stringstream delta;
+    ecs::encode_delta<position, velocity, damage>(server, baseline, delta);
+
+    // a truncated delta changes nothing, even where it
+    // is complete enough to destroy and create entities
+    const auto encoded = delta.str();
+    for (const auto size : { encoded.size() / 4, encoded.size() / 2, encoded.size() - 1 }) {
+        std::stringstream truncated(encoded.substr(0, size));
+        CHECK_THROWS_AS((ecs::apply_delta<position, velocity, damage>(client, truncated)),
+                std::runtime_error);
+        CHECK(ecs::contains(client, ents[3]));
+        CHECK_FALSE(ecs::contains(client, spawned));
+        CHECK(ecs::get<velocity>(client, ents[4]).dx == 1.0f);
+        CHECK(ecs::get<position>(client, ents[0]).x == 0.0f);
+    }
+
+    ecs::apply_delta<position, velocity, damage>(client, delta);
+
+    CHECK_FALSE(ecs::contains(client, ents[3]));
+    CHECK_THROWS_AS(ecs::get<velocity>(client, ents[4]), std::invalid_argument);
+    CHECK(ecs::get<damage>(client, ents[6]).amount == 6.0f);
+    CHECK(ecs::get<damage>(client, ents[6]).owner == ents[6]);
+    CHECK(ecs::get<position>(client, spawned).x == 100.0f);
+    CHECK(ecs::get<damage>(client, spawned).amount == 7.0f);
+
+    for (int i = 0; i < 50; ++i) {
+        if (i == 3)
+            continue;
+        CHECK(ecs::get<position>(client, ents[i]).x
+                == ecs::get<position>(server, ents[i]).x);
+    }
+
+    int count = 0;
+    for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(client)) {
+        ++count;
+    }
+    CHECK(count == 48);
+
+    // an unchanged state encodes to little more than a header
+    std::stringstream unchanged;
+    ecs::encode_delta<position>(server, server, unchanged);
+    CHECK(unchanged.str().size() < 32);
+
+    // the client is no longer in the baseline state
+    delta.clear();
+    delta.seekg(0);
+    CHECK_THROWS_AS((ecs::apply_delta<position, velocity, damage>(client, delta)),
+            std::invalid_argument);
+    CHECK(ecs::get<position>(client, spawned).x == 100.0f);
+    CHECK(ecs::get<damage>(client, ents[6]).amount == 6.0f);
+}
+
+TEST_CASE("Clone") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 100; ++i) {
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f),
+                velocity(1.0f, 0.0f), name(std::to_string(i))));
+    }
+    for (int i = 0; i < 100; i += 7)
+        ecs::destroy(reg, ents[i]);
+    ecs::emplace<damage>(reg, ents[1], 5.0f);
+
+    // grouped and colony components in the same range
+    ecs::group<position, velocity>(reg);
+    ecs::range<position, name>(reg);
+    ecs::range<name, velocity>(reg);
+    ecs::singleton(reg, world_time(0.5f));
+
+    auto copy = ecs::clone(reg);
+
+    SUBCASE("copies every entity") {
+        for (int i = 0; i < 100; ++i) {
+            CHECK(ecs::contains(copy, ents[i]) == (i % 7 != 0));
+            if (i % 7 == 0)
+                continue;
+            CHECK(ecs::get<position>(copy, ents[i]).x == float(i));
+            CHECK(ecs::get<name>(copy, ents[i]).value == std::to_string(i));
+            CHECK(&ecs::get<name>(copy, ents[i]) != &ecs::get<name>(reg, ents[i]));
+        }
+        CHECK(ecs::sibling<position>(copy, ecs::get<damage>(copy, ents[1])).x == 1.0f);
+        CHECK(ecs::singleton<world_time>(copy).delta_time == 0.5f);
+
+        // both hand out the same handles afterwards
+        CHECK(ecs::create(copy) == ecs::create(reg));
+    }
+
+    SUBCASE("ranges and groups point into the copy") {
+        for (auto& [pos, n] : ecs::range<position, name>(copy)) {
+            pos.y = 1.0f;
+            n.value += "!";
+        }
+        for (auto& [n, vel] : ecs::range<name, velocity>(copy))
+            vel.dy = n.value.size();
+        for (auto& [pos, vel] : ecs::group<position, velocity>(copy))
+            pos.x += vel.dx;
+
+        int count = 0;
+        for (auto& [pos, n] : ecs::range<position, name>(reg)) {
+            CHECK(pos.y == 0.0f);
+            CHECK(n.value.back() != '!');
+            ++count;
+        }
+        CHECK(count == 85);
+
+        for (int i = 1; i < 100; ++i) {
+            if (i % 7 == 0)
+                continue;
+            CHECK(ecs::get<position>(copy, ents[i]) == position(float(i) + 1.0f, 1.0f));
+            CHECK(ecs::get<velocity>(copy, ents[i]).dy
+                    == float(std::to_string(i).size() + 1));
+            CHECK(ecs::get<position>(reg, ents[i]).x == float(i));
+        }
+    }
+
+    SUBCASE("copies evolve independently") {
+        ecs::destroy(copy, ents[1]);
+        auto spawned = ecs::create(copy, position(7.0f), velocity(), name("new"));
+        CHECK(ecs::contains(reg, ents[1]));
+        CHECK_FALSE(ecs::contains(reg, spawned));
+        int count = 0;
+        for ([[maybe_unused]] auto& [pos, n] : ecs::range<position, name>(copy))
+            ++count;
+        CHECK(count == 85);
+        CHECK(ecs::get<name>(copy, spawned).value == "new");
+    }
+
+    SUBCASE("non-copyable singletons cannot be cloned") {
+        ecs::singleton(reg, std::make_unique<int>(1));
+        CHECK_THROWS_AS(ecs::clone(reg), std::logic_error);
+    }
+}
+
+TEST_CASE("Journal Replay") {
+    ecs::registry reg;
+    auto initial = ecs::create(reg, position(1.0f, 1.0f));
+    std::stringstream stream;
+    {
+        // small enough to wrap and fill up
+        ecs::journal journal(stream, 64);
+        ecs::set_journal(reg, &journal);
+
+        std::vector<ecs::handle_type> ents;
+        for (int i = 0; i < 40; ++i)
+            ents.push_back(ecs::create(reg, position(float(i), 0.0f), velocity(1.0f, 0.0f)));
+        ecs::emplace<damage>(reg, ents[2], 2.0f);
+        ecs::remove<velocity>(reg, ents[3]);
+        ecs::destroy(reg, ents[4]);
+        ecs::destroy_if<position>(reg, [](const position& p) { return p.x > 30.0f; });
+        ecs::clear<damage>(reg);
+        ecs::emplace<damage>(reg, ents[5], 5.0f);
+        ecs::create(reg);
+
+        ecs::get<position>(reg, initial).y = 9.0f;
+        ecs::mark_written<position>(reg, initial);
+
+        CHECK_THROWS_AS(ecs::create(reg, name("not trivially copyable")),
+                std::logic_error);
+
+        journal.flush();
+        ecs::set_journal(reg, nullptr);
+    }
+
+    ecs::registry replayed;
+    ecs::create(replayed, position(1.0f, 1.0f));
+    const auto recorded = stream.str();
+    CHECK(ecs::replay<position, velocity, damage>(replayed, stream) == 56);
+
+    const auto check_same = [&reg](ecs::registry& other, ecs::handle_type ent) {
+        REQUIRE(ecs::contains(other, ent) == ecs::contains(reg, ent));
+        if (!ecs::contains(reg, ent))
+            return;
+        CHECK(ecs::get<position>(other, ent) == ecs::get<position>(reg, ent));
+    };
+    for (ecs::handle_type ent = initial; ent < initial + 41; ++ent)
+        check_same(replayed, ent);
+
+    CHECK(ecs::get<position>(replayed, initial).y == 9.0f);
+    CHECK(ecs::get<damage>(replayed, initial + 6).amount == 5.0f);
+    CHECK_THROWS_AS(ecs::get<velocity>(replayed, initial + 4), std::invalid_argument);
+    CHECK(ecs::create(replayed) == ecs::create(reg));
+
+    SUBCASE("a truncated record is ignored") {
+        ecs::registry partial;
+        ecs::create(partial, position(1.0f, 1.0f));
+        std::stringstream cut(recorded.substr(0, recorded.size() - 3));
+        CHECK(ecs::replay<position, velocity, damage>(partial, cut) == 55);
+        CHECK(ecs::get<position>(partial, initial).y == 1.0f);
+    }
+
+    SUBCASE("mismatching registries are detected") {
+        ecs::registry empty;
+        std::stringstream in(recorded);
+        CHECK_THROWS_AS((ecs::replay<position, velocity, damage>(empty, in)),
+                std::invalid_argument);
+    }
+}
+
+TEST_CASE("Baked Segments") {
+    struct node {
+        float x, y;
+        ecs::handle_type owner{};
+    };
+    struct cost {
+        std::int64_t value;
+    };
+
+    const auto path = std::filesystem::temp_directory_path() / "ecs_baked_test.bin";
+
+    {
+        ecs::registry level;
+        for (int i = 0; i < 100; ++i) {
+            auto ent = ecs::create(level, node{ float(i), 1.0f });
+            if (i % 2 == 0)
+                ecs::emplace(level, ent, cost{ i });
+        }
+        // grouped components are baked as well
+        ecs::group<node, cost>(level);
+
+        std::ofstream out(path, std::ios::binary);
+        ecs::bake<node, cost>(level, out);
+    }
+
+    ecs::baked_segment segment(path);
+    CHECK(segment.size() == 50);
+    CHECK(segment.has<node>());
+    CHECK_FALSE(segment.has<position>());
+    CHECK(std::ranges::is_sorted(segment.entities()));
+    CHECK(reinterpret_cast<std::uintptr_t>(segment.components<cost>().data())
+            % ecs::baked_segment::alignment == 0);
+
+    int count = 0;
+    for (auto& [n, c] : ecs::range<node, cost>(segment)) {
+        CHECK(n.x == float(c.value));
+        CHECK(segment.get<cost>(n.owner).value == c.value);
+        ++count;
+    }
+    CHECK(count == 50);
+    CHECK_THROWS_AS(ecs::range<position>(segment), std::invalid_argument);
+    CHECK_THROWS_AS(segment.get<node>(2), std::out_of_range);
+
+    // dynamic entities live next to the baked ones
+    ecs::registry reg;
+    ecs::attach(reg, segment);
+    auto dynamic = ecs::create(reg, node{ -1.0f, 0.0f });
+    CHECK_FALSE(segment.contains(dynamic));
+    CHECK(dynamic > segment.entities().back());
+
+    std::filesystem::remove(path);
+    std::ofstream(path, std::ios::binary) << "not a segment, but long enough to have a header";
+    CHECK_THROWS_AS(ecs::baked_segment{ path }, std::invalid_argument);
+    std::filesystem::remove(path);
+    CHECK_THROWS_AS(ecs::baked_segment{ path }, std::runtime_error);
+}
+
+TEST_CASE("Spawn Buffers") {
+    ecs::registry reg;
+    auto before = ecs::create(reg, position(-1.0f, 0.0f), velocity());
+    ecs::range<position, velocity>(reg);
+    ecs::group<position, damage>(reg);
+
+    constexpr int workers = 4;
+    constexpr int spawns = 500;
+    std::vector<std::unique_ptr<ecs::spawn_buffer>> buffers;
+    for (int w = 0; w < workers; ++w)
+        buffers.push_back(std::make_unique<ecs::spawn_buffer>(reg, 16));
+
+    std::vector<std::vector<ecs::handle_type>> spawned(workers);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            for (int i = 0; i < spawns; ++i) {
+                const auto x = float(w * spawns + i);
+                spawned[w].push_back(i % 2 == 0
+                    ? ecs::create(*buffers[w], position(x, 0.0f), velocity(1.0f, 0.0f))
+                    : ecs::create(*buffers[w], position(x, 0.0f), damage(x)));
+            }
+        });
+    }
+    // the owner keeps creating entities meanwhile
+    std::vector<ecs::handle_type> owned;
+    for (int i = 0; i < 100; ++i)
+        owned.push_back(ecs::create(reg));
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK_FALSE(ecs::contains(reg, spawned[0][0]));
+    for (auto& buffer : buffers) {
+        CHECK(buffer->size() == spawns);
+        ecs::publish(reg, *buffer);
+        CHECK(buffer->empty());
+    }
+
+    // handles are unique across threads
+    std::vector<ecs::handle_type> all = owned;
+    all.push_back(before);
+    for (const auto& handles : spawned)
+        all.insert(all.end(), handles.begin(), handles.end());
+    std::ranges::sort(all);
+    CHECK(std::ranges::adjacent_find(all) == all.end());
+
+    for (int w = 0; w < workers; ++w) {
+        for (int i = 0; i < spawns; ++i) {
+            const auto ent = spawned[w][i];
+            REQUIRE(ecs::contains(reg, ent));
+            CHECK(ecs::get<position>(reg, ent).x == float(w * spawns + i));
+            if (i % 2 == 1)
+                CHECK(ecs::get<damage>(reg, ent).owner == ent);
+        }
+    }
+
+    int moving = 0;
+    for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg))
+        ++moving;
+    CHECK(moving == 1 + workers * spawns / 2);
+
+    int grouped = 0;
+    for ([[maybe_unused]] auto& [pos, dmg] : ecs::group<position, damage>(reg))
+        ++grouped;
+    CHECK(grouped == workers * spawns / 2);
+
+    SUBCASE("a throwing component publishes every entity once") {
+        ecs::spawn_buffer buffer(reg);
+        const auto first = ecs::create(buffer, position(1.0f, 0.0f));
+        const auto failing = ecs::create(buffer, position(-2.0f, 0.0f), fragile{ true });
+        const auto last = ecs::create(buffer, position(3.0f, 0.0f), fragile{ false });
+
+        fragile::armed = true;
+        CHECK_THROWS_AS(ecs::publish(reg, buffer), std::runtime_error);
+        fragile::armed = false;
+        CHECK(ecs::contains(reg, first));
+        CHECK_FALSE(ecs::contains(reg, failing));
+        CHECK_FALSE(ecs::contains(reg, last));
+        CHECK(buffer.size() == 1);
+
+        // the position of the failed entity was destroyed again
+        int failed = 0;
+        for (const auto& pos : ecs::range<position>(reg))
+            failed += pos.x == -2.0f;
+        CHECK(failed == 0);
+
+        ecs::publish(reg, buffer);
+        CHECK(buffer.empty());
+        CHECK(ecs::get<position>(reg, first).x == 1.0f);
+        CHECK(ecs::get<position>(reg, last).x == 3.0f);
+    }
+}
+
+TEST_CASE("Frozen Registry") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 1000; ++i) {
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f),
+                velocity(1.0f, 0.0f), damage(1.0f)));
+    }
+    ecs::singleton(reg, world_time());
+    ecs::range<position, velocity>(reg);
+    ecs::defer_range_updates(reg, true);
+    auto late = ecs::create(reg, position(), velocity());
+
+    ecs::freeze(reg);
+
+    SUBCASE("structural changes throw") {
+        CHECK_THROWS_AS(ecs::create(reg), std::logic_error);
+        CHECK_THROWS_AS(ecs::destroy(reg, ents[0]), std::logic_error);
+        CHECK_THROWS_AS(ecs::emplace<health>(reg, ents[0]), std::logic_error);
+        CHECK_THROWS_AS(ecs::remove<damage>(reg, ents[0]), std::logic_error);
+        CHECK_THROWS_AS((ecs::range<position, damage>(reg)), std::logic_error);
+        CHECK_THROWS_AS((ecs::group<position, damage>(reg)), std::logic_error);
+        CHECK_THROWS_AS(ecs::optimize(reg), std::logic_error);
+
+        // types without components stay empty, readers
+        // do not add a storage for them
+        const auto storages = ecs::stats(reg).storages.size();
+        CHECK(ecs::range<health>(reg).begin() == ecs::range<health>(reg).end());
+        CHECK(ecs::stats(reg).storages.size() == storages);
+
+        ecs::thaw(reg);
+        CHECK_NOTHROW(ecs::destroy(reg, ents[0]));
+    }
+
+    SUBCASE("readers run next to a writer") {
+        // pending updates were applied when freezing
+        int count = 0;
+        for ([[maybe_unused]] auto& [pos, vel] : ecs::range<position, velocity>(reg))
+            ++count;
+        CHECK(count == 1001);
+        CHECK(ecs::contains(reg, late));
+
+        std::vector<double> sums(3, 0.0);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&, r] {
+                auto lock = ecs::read_lock<position, velocity>(reg);
+                for (auto& [pos, vel] : ecs::range<position, velocity>(reg))
+                    sums[r] += pos.x + vel.dx;
+                for (const auto ent : ents)
+                    sums[r] += ecs::get<position>(reg, ent).y;
+                sums[r] += ecs::singleton<world_time>(reg).total_time;
+            });
+        }
+
+        for (int frame = 0; frame < 10; ++frame) {
+            auto lock = ecs::write_lock<damage>(reg);
+            for (auto& dmg : ecs::range<damage>(reg))
+                dmg.amount += 1.0f;
+        }
+
+        for (auto& reader : readers)
+            reader.join();
+
+        for (const auto sum : sums)
+            CHECK(sum == 1000.0 * 999.0 / 2.0 + 1000.0);
+        CHECK(ecs::get<damage>(reg, ents[5]).amount == 11.0f);
+    }
+
+    ecs::thaw(reg);
+}
+
+TEST_CASE("Double Buffered Components") {
+    using boid = ecs::double_buffered<position>;
+
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 1000; ++i)
+        ents.push_back(ecs::create(reg, boid(position(float(i), 0.0f)), velocity(1.0f, 2.0f)));
+    ecs::create(reg, boid());
+
+    const auto step = [&reg] {
+        auto range = ecs::range<ecs::read_prev<position>, ecs::write_next<position>, velocity>(reg);
+        CHECK(range.size() == 1000);
+
+        constexpr size_t workers = 4;
+        const auto chunk = (range.size() + workers - 1) / workers;
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([range, w, chunk] {
+                for (auto& [prev, next, vel] : range.slice(w * chunk, chunk)) {
+                    static_assert(std::is_const_v<std::remove_reference_t<decltype(prev)>>);
+                    next.x = prev.x + vel.dx;
+                    next.y = prev.y + vel.dy;
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    };
+
+    step();
+    // nothing is visible before the tick
+    CHECK(ecs::get<boid>(reg, ents[3]).prev(ecs::current_tick(reg)).x == 3.0f);
+    ecs::tick(reg);
+    CHECK(ecs::get<boid>(reg, ents[3]).prev(ecs::current_tick(reg)).x == 4.0f);
+
+    step();
+    ecs::tick(reg);
+    for (int i = 0; i < 1000; ++i) {
+        const auto& pos = ecs::get<boid>(reg, ents[i]).prev(ecs::current_tick(reg));
+        CHECK(pos.x == float(i + 2));
+        CHECK(pos.y == 4.0f);
+    }
+
+    // both markers alone share the range of the stored type
+    size_t count = 0;
+    for (auto& [prev] : ecs::range<ecs::read_prev<position>>(reg)) {
+        (void)prev;
+        ++count;
+    }
+    CHECK(count == 1001);
+    CHECK(ecs::range<ecs::write_next<position>>(reg).slice(990, 100).size() == 11);
+    CHECK(ecs::usage<boid, velocity>(reg)->hits == 2);
+}
+
+TEST_CASE("Range Cursors") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 100; ++i)
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f), velocity()));
+
+    std::vector<int> visits(200);
+    ecs::range_cursor<position, velocity> cursor;
+    const auto visit = [&visits](position& pos, velocity&) {
+        ++visits[int(pos.x)];
+    };
+
+    CHECK_FALSE(ecs::resume(reg, cursor, visit, 30));
+    CHECK(cursor.remaining() == 70);
+
+    // structural changes between the slices of a pass
+    ecs::destroy(reg, ents[90]);
+    ecs::remove<velocity>(reg, ents[91]);
+    ecs::range<position, velocity>(reg);
+    for (int i = 100; i < 110; ++i)
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f), velocity()));
+    ecs::tick(reg);
+
+    while (!ecs::resume(reg, cursor, visit, 30))
+        ecs::tick(reg);
+    CHECK(cursor.passes() == 1);
+
+    for (int i = 0; i < 110; ++i)
+        CHECK(visits[i] == (i == 90 || i == 91 || i >= 100 ? 0 : 1));
+
+    // the next pass picks up the new entities
+    CHECK(ecs::resume(reg, cursor, visit, 1000));
+    CHECK(cursor.passes() == 2);
+    for (int i = 0; i < 110; ++i)
+        CHECK(visits[i] == (i == 90 || i == 91 ? 0 : i < 100 ? 2 : 1));
+
+    // an exhausted budget stops after one entity
+    ecs::range_cursor<position> single;
+    CHECK_FALSE(ecs::resume(reg, single, [](position&) {}, 1000,
+        std::chrono::nanoseconds(0)));
+    CHECK(single.remaining() == 108);
+    single.reset();
+    CHECK(single.remaining() == 0);
+}
+
+namespace {
+
+ecs::task<int> count_moved(ecs::scheduler& sched, ecs::registry& reg) {
+    std::atomic<int> moved = 0;
+    co_await sched.for_each(ecs::range<position, velocity>(reg), [&moved](auto& row) {
+        auto& [pos, vel] = row;
+        pos.x += vel.dx;
+        ++moved;
+    }, 100);
+    co_return moved.load();
+}
+
+ecs::task<> simulate(ecs::scheduler& sched, ecs::registry& reg, std::vector<int>& moved) {
+    for (int frame = 0; frame < 3; ++frame) {
+        moved.push_back(co_await count_moved(sched, reg));
+        co_await sched.next_tick();
+    }
+}
+
+} // namespace
+
+TEST_CASE("Coroutine Tasks") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 1050; ++i)
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f), velocity(1.0f, 0.0f)));
+
+    ecs::scheduler sched(4);
+    std::vector<int> moved;
+    auto done = sched.spawn(simulate(sched, reg, moved));
+    while (done.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+        sched.tick();
+    done.get();
+
+    CHECK(moved == std::vector<int>{ 1050, 1050, 1050 });
+    CHECK(ecs::get<position>(reg, ents[7]).x == 10.0f);
+
+    // a throwing chunk fails the awaiting task
+    auto failing = [](ecs::scheduler& sched, ecs::registry& reg) -> ecs::task<> {
+        co_await sched.for_each(ecs::range<position>(reg), [](position& pos) {
+            if (pos.x > 1000.0f)
+                throw std::runtime_error("out of bounds");
+        }, 64);
+    };
+    CHECK_THROWS_AS(sched.spawn(failing(sched, reg)).get(), std::runtime_error);
+
+    // empty ranges do not suspend
+    ecs::registry empty;
+    auto none = [](ecs::scheduler& sched, ecs::registry& reg) -> ecs::task<int> {
+        int calls = 0;
+        co_await sched.for_each(ecs::range<position, velocity>(reg), [&calls](auto&) { ++calls; });
+        co_return calls;
+    };
+    CHECK(sched.spawn(none(sched, empty)).get() == 0);
+
+    // tasks waiting for a tick fail when the scheduler goes
+    auto waiting = [](ecs::scheduler& sched, std::atomic<bool>& suspended) -> ecs::task<> {
+        suspended = true;
+        co_await sched.next_tick();
+    };
+    std::future<void> orphaned;
+    {
+        ecs::scheduler local(2);
+        std::atomic<bool> suspended = false;
+        orphaned = local.spawn(waiting(local, suspended));
+        while (!suspended)
+            std::this_thread::yield();
+    }
+    REQUIRE(orphaned.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK_THROWS_AS(orphaned.get(), std::runtime_error);
+}
+
+TEST_CASE("Trace Export") {
+    ecs::trace::clear();
+    {
+        const ecs::trace::scope outer("outer \"system\"");
+        std::thread([] { const ecs::trace::scope inner("worker"); }).join();
+    }
+
+    std::stringstream out;
+    ecs::trace::write_chrome_trace(out);
+    const auto json = out.str();
+
+    CHECK(json.starts_with("{\"traceEvents\":["));
+    CHECK(json.find("\"name\":\"outer \\\"system\\\"\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"worker\"") != std::string::npos);
+    CHECK(json.find("\"displayTimeUnit\":\"ns\"}") != std::string::npos);
+
+    ecs::trace::clear();
+    std::stringstream empty;
+    ecs::trace::write_chrome_trace(empty);
+    CHECK(empty.str().find("\"name\"") == std::string::npos);
+
+    // exporting while a thread wraps around its buffer only
+    // leaves out the events it overwrites
+    std::atomic<bool> stop = false;
+    std::thread recorder([&stop] {
+        while (!stop)
+            const ecs::trace::scope spin("spin");
+    });
+    for (int i = 0; i < 20; ++i) {
+        std::stringstream during;
+        ecs::trace::write_chrome_trace(during);
+        ecs::trace::clear();
+        CHECK(during.str().ends_with("\"displayTimeUnit\":\"ns\"}\n"));
+        CHECK(during.str().find("\"name\":\"\"") == std::string::npos);
+    }
+    stop = true;
+    recorder.join();
+}
+
+TEST_CASE("Performance Counters") {
+    ecs::registry reg;
+    for (int i = 0; i < 1000; ++i)
+        ecs::create(reg, position(float(i), 0.0f), velocity(1.0f, 0.0f));
+
+    ecs::perf::profiler prof;
+    const auto move = [](ecs::registry& reg) {
+        for (auto& [pos, vel] : ecs::range<position, velocity>(reg))
+            pos.x += vel.dx;
+    };
+    for (int frame = 0; frame < 3; ++frame)
+        prof.run("move", move, reg);
+    {
+        const auto measured = prof.measure("sum");
+        float sum = 0.0f;
+        for (auto& pos : ecs::range<position>(reg))
+            sum += pos.x;
+        CHECK(sum > 0.0f);
+    }
+    CHECK(prof.run("answer", [] { return 42; }) == 42);
+
+    const auto results = prof.results();
+    REQUIRE(results.size() == 3);
+    CHECK(results.at("move").calls == 3);
+    CHECK(results.at("sum").calls == 1);
+
+    // without perf events only the calls are counted
+    const auto& instructions = results.at("move")[ecs::perf::counter::instructions];
+    if (prof.available()) {
+        CHECK(instructions.has_value());
+    } else {
+        for (const auto& count : results.at("move").counts)
+            CHECK_FALSE(count.has_value());
+    }
+
+    std::stringstream report;
+    prof.report(report);
+    CHECK(report.str().find("move") != std::string::npos);
+    CHECK(report.str().find("branch misses") != std::string::npos);
+
+    prof.clear();
+    CHECK(prof.results().empty());
+}
+
+TEST_CASE("Registry Statistics") {
+    ecs::registry reg;
+    std::vector<ecs::handle_type> ents;
+    for (int i = 0; i < 100; ++i)
+        ents.push_back(ecs::create(reg, position(float(i), 0.0f), velocity()));
+    for (int i = 0; i < 10; ++i)
+        ecs::create(reg, health{});
+    // leave the first block of positions sparse
+    for (int i = 0; i < 24; ++i)
+        ecs::destroy(reg, ents[i]);
+    ecs::range<position, velocity>(reg);
+
+    const auto stats = ecs::stats(reg);
+    const auto pos = std::ranges::find(stats.storages,
+        ecs::detail::type_hash<position>(), &ecs::storage_stats::hash);
+    REQUIRE(pos != stats.storages.end());
+
+    CHECK(pos->size == 76);
+    CHECK(pos->capacity == 128);
+    CHECK(pos->blocks == 4);
+    CHECK(pos->component_size == sizeof(position));
+    CHECK(pos->bytes >= pos->capacity * sizeof(position));
+    CHECK(pos->fill() == doctest::Approx(76.0 / 128.0));
+    // blocks of 32: 8, 32, 32 and 4 used slots
+    REQUIRE(pos->occupancy.size() == 33);
+    CHECK(pos->occupancy[8] == 1);
+    CHECK(pos->occupancy[32] == 2);
+    CHECK(pos->occupancy[4] == 1);
+
+    REQUIRE(stats.ranges.size() == 1);
+    CHECK(stats.ranges[0].rows == 76);
+    CHECK(stats.ranges[0].types.size() == 2);
+    CHECK(stats.ranges[0].bytes >= 76 * 3 * sizeof(void*));
+
+    CHECK(stats.entities.entities == 86);
+    CHECK(stats.entities.components == 76 * 2 + 10);
+    CHECK(stats.entities.per_entity() > 0.0);
+
+    ecs::group<position, velocity>(reg);
+    const auto grouped = ecs::stats(reg);
+    REQUIRE(grouped.groups.size() == 1);
+    CHECK(grouped.groups[0].size == 76);
+    CHECK(grouped.groups[0].capacity >= 76);
+    CHECK(grouped.groups[0].bytes >= 76 * (sizeof(position) + sizeof(velocity)));
+    CHECK(grouped.bytes() > grouped.entities.bytes());
+}